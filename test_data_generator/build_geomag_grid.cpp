@@ -0,0 +1,197 @@
+// Builds a .hrzgeo geomagnetic field grid (see geomag_grid.h) from MAG_Geomag
+// over the MIN_ALTITUDE to MAX_ALTITUDE band, then measures how far
+// interpolating it is from MAG_Geomag.
+//
+// Usage: ./build_geomag_grid <output.hrzgeo> [degrees between points] [km between altitudes]
+//
+// The defaults (1 degree, 25 km) keep the interpolation error well under one
+// magnetometer LSB.
+
+#include "geomag_grid.h"
+#include "constants.h"
+#include "wmm_embedded.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const unsigned int ERROR_CHECK_POINTS = 200000;
+
+struct Geomag
+{
+    MAGtype_MagneticModel* magnetic_models[1];
+    MAGtype_Ellipsoid ellipsoid;
+    MAGtype_Geoid geoid;
+};
+
+// Same inputs as compute_outputs gives MAG_Geomag
+static void reference_field(const Geomag& geomag, double latitude, double longitude, double altitude, double field[3])
+{
+    MAGtype_CoordSpherical spherical_coord;
+    MAGtype_CoordGeodetic geo_coord;
+    MAGtype_GeoMagneticElements magnetic_field;
+
+    spherical_coord.lambda = longitude;
+    spherical_coord.phig = latitude;
+    spherical_coord.r = EARTH_RADIUS + altitude;
+
+    MAG_SphericalToGeodetic(geomag.ellipsoid, spherical_coord, &geo_coord);
+    MAG_Geomag(geomag.ellipsoid, spherical_coord, geo_coord, geomag.magnetic_models[0], &magnetic_field);
+
+    field[0] = magnetic_field.X;
+    field[1] = magnetic_field.Y;
+    field[2] = magnetic_field.Z;
+}
+
+// Number of points needed to cover `range` in steps of `step`, or 0 if the
+// step doesn't divide the range
+static uint32_t point_count(double range, double step)
+{
+    double intervals = range / step;
+    if (step <= 0.0 || fabs(intervals - round(intervals)) > 1e-6)
+    {
+        return 0;
+    }
+    return (uint32_t)round(intervals) + 1;
+}
+
+int main(int argc, char** args)
+{
+    if (argc < 2 || argc > 4)
+    {
+        cout << "Usage: ./build_geomag_grid <output.hrzgeo> [degrees between points] [km between altitudes]" << endl;
+        return 1;
+    }
+    const char* filename = args[1];
+    double angle_step = argc > 2 ? atof(args[2]) : 1.0;
+    double altitude_step = argc > 3 ? atof(args[3]) : 25.0;
+
+    GeomagGridHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GEOMAG_GRID_MAGIC, sizeof(GEOMAG_GRID_MAGIC));
+    header.version = GEOMAG_GRID_VERSION;
+    header.latitude_count = point_count(180.0, angle_step);
+    header.longitude_count = point_count(360.0, angle_step);
+    header.altitude_count = point_count(MAX_ALTITUDE - MIN_ALTITUDE, altitude_step);
+    header.latitude_min = -90.0f;
+    header.latitude_step = angle_step;
+    header.longitude_min = -180.0f;
+    header.longitude_step = angle_step;
+    header.altitude_min = MIN_ALTITUDE;
+    header.altitude_step = altitude_step;
+    header.data_offset = GEOMAG_GRID_ALIGNMENT;
+
+    if (header.latitude_count < 2 || header.longitude_count < 2 || header.altitude_count < 2)
+    {
+        cerr << "The steps have to divide 180 degrees and " << MAX_ALTITUDE - MIN_ALTITUDE << " km evenly" << endl;
+        return 1;
+    }
+
+    Geomag geomag;
+    geomag.magnetic_models[0] = wmm_embedded_model();
+    if (!geomag.magnetic_models[0])
+    {
+        cerr << "Couldn't allocate the magnetic field model" << endl;
+        return 1;
+    }
+    MAG_SetDefaults(&geomag.ellipsoid, &geomag.geoid);
+
+    // The untimed model, the same as compute_outputs
+    header.model_year = geomag.magnetic_models[0]->epoch;
+
+    size_t point_total = (size_t)header.altitude_count * header.latitude_count * header.longitude_count;
+    std::vector<float> field(point_total * 3);
+    size_t point = 0;
+    for (uint32_t k = 0; k < header.altitude_count; ++k)
+    {
+        for (uint32_t i = 0; i < header.latitude_count; ++i)
+        {
+            for (uint32_t j = 0; j < header.longitude_count; ++j)
+            {
+                double value[3];
+                reference_field(geomag,
+                                header.latitude_min + i * angle_step,
+                                header.longitude_min + j * angle_step,
+                                header.altitude_min + k * altitude_step,
+                                value);
+                field[point * 3 + 0] = value[0];
+                field[point * 3 + 1] = value[1];
+                field[point * 3 + 2] = value[2];
+                ++point;
+            }
+        }
+    }
+
+    // Check the interpolation with the same lookup everything else uses,
+    // reading the table from memory
+    GeomagGrid grid;
+    grid.data = nullptr;
+    grid.size = 0;
+    grid.header = &header;
+    grid.field = field.data();
+
+    std::mt19937 engine(1);
+    std::uniform_real_distribution<float> latitude_dist(-90.0f, 90.0f);
+    std::uniform_real_distribution<float> longitude_dist(-180.0f, 180.0f);
+    std::uniform_real_distribution<float> altitude_dist(MIN_ALTITUDE, MAX_ALTITUDE);
+
+    double max_error = 0.0;
+    double sum_sq_error = 0.0;
+    float worst_point[3] = {};
+    for (unsigned int n = 0; n < ERROR_CHECK_POINTS; ++n)
+    {
+        float latitude = latitude_dist(engine);
+        float longitude = longitude_dist(engine);
+        float altitude = altitude_dist(engine);
+
+        double reference[3];
+        reference_field(geomag, latitude, longitude, altitude, reference);
+        float interpolated[3];
+        geomag_grid_lookup(&grid, latitude, longitude, altitude, interpolated);
+
+        for (int c = 0; c < 3; ++c)
+        {
+            double error = fabs(interpolated[c] - reference[c]);
+            sum_sq_error += error * error;
+            if (error > max_error)
+            {
+                max_error = error;
+                worst_point[0] = latitude;
+                worst_point[1] = longitude;
+                worst_point[2] = altitude;
+            }
+        }
+    }
+    header.max_error = max_error;
+    header.rms_error = sqrt(sum_sq_error / (3.0 * ERROR_CHECK_POINTS));
+
+    std::ofstream file(filename, std::ios::binary);
+    std::vector<char> padded_header(header.data_offset, 0);
+    memcpy(padded_header.data(), &header, sizeof(header));
+    file.write(padded_header.data(), padded_header.size());
+    file.write((const char*)field.data(), field.size() * sizeof(float));
+    if (!file)
+    {
+        cerr << "Couldn't write " << filename << endl;
+        return 1;
+    }
+
+    // One magnetometer LSB in nT, see compute_outputs
+    double lsb = MAGNETIC_FIELD_SENSITIVITY / 0.001;
+    cout << "Wrote " << header.latitude_count << " x " << header.longitude_count << " x " << header.altitude_count
+         << " grid to " << filename << " (" << (header.data_offset + field.size() * sizeof(float)) / (1024.0 * 1024.0) << " MB)" << endl;
+    cout << "Interpolation error over " << ERROR_CHECK_POINTS << " random points: worst " << header.max_error
+         << " nT (" << header.max_error / lsb << " LSB) at latitude " << worst_point[0] << ", longitude " << worst_point[1]
+         << ", altitude " << worst_point[2] << ", RMS " << header.rms_error << " nT (" << header.rms_error / lsb << " LSB)" << endl;
+
+    MAG_FreeMagneticModelMemory(geomag.magnetic_models[0]);
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include "capture.h"
+#include "cpu_renderer.h"
+#include "profiler.h"
+
+#include <chrono>
+#include <cstring>
+
+// Copies a bottom-row-first width x height frame, whose rows are `src_stride`
+// pixels apart, into a top-row-first one
+static void copy_flipped(uint16_t* dst, const uint16_t* src, uint32_t width, uint32_t height, size_t src_stride)
+{
+    for (uint32_t i = 0; i < height; ++i)
+    {
+        memcpy(dst + (size_t)i * width, src + (height - i - 1) * src_stride, width * sizeof(uint16_t));
+    }
+}
+
+static size_t frame_pixels(const RenderState* render_state)
+{
+    return (size_t)render_state->camera_width * render_state->camera_height;
+}
+
+void capture_init(FrameCapture* capture, RenderState* render_state, unsigned int batch_size)
+{
+    capture->render_state = render_state;
+    capture->oldest = 0;
+    capture->in_flight = 0;
+
+    if (render_state->renderer != RENDERER_GL_OFFSCREEN || batch_size == 0)
+    {
+        // Only the offscreen framebuffer is big enough for an atlas
+        batch_size = 1;
+    }
+    else if (batch_size > render_state->batch_max)
+    {
+        batch_size = render_state->batch_max;
+    }
+    capture->batch_size = batch_size;
+
+    unsigned int columns, rows;
+    render_atlas_size(*render_state, batch_size, &columns, &rows);
+    size_t atlas_bytes = columns * rows * frame_pixels(render_state) * sizeof(uint16_t);
+
+    for (int i = 0; i < CAPTURE_RING_SIZE; ++i)
+    {
+        CaptureBatch* batch = &capture->batches[i];
+        batch->count = 0;
+        batch->retrieved = 0;
+        batch->indices.resize(batch_size);
+        batch->states.resize(batch_size);
+
+        if (render_state->renderer == RENDERER_CPU)
+        {
+            batch->pixels.resize(batch_size * frame_pixels(render_state));
+        }
+        else
+        {
+            glGenBuffers(1, &batch->pbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, batch->pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, atlas_bytes, NULL, GL_STREAM_READ);
+        }
+    }
+
+    if (render_state->renderer != RENDERER_CPU)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
+
+void capture_cleanup(FrameCapture* capture)
+{
+    if (capture->render_state->renderer == RENDERER_CPU)
+    {
+        return;
+    }
+
+    for (int i = 0; i < CAPTURE_RING_SIZE; ++i)
+    {
+        CaptureBatch* batch = &capture->batches[i];
+        if (batch->mapped)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, batch->pbo);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            batch->mapped = nullptr;
+        }
+        if (batch->fence)
+        {
+            glDeleteSync(batch->fence);
+            batch->fence = 0;
+        }
+        glDeleteBuffers(1, &batch->pbo);
+        batch->pbo = 0;
+    }
+}
+
+bool capture_full(const FrameCapture* capture)
+{
+    return capture->in_flight == CAPTURE_RING_SIZE;
+}
+
+bool capture_empty(const FrameCapture* capture)
+{
+    if (capture->in_flight > 0)
+    {
+        return false;
+    }
+    return capture->batches[capture->oldest].count == 0;
+}
+
+// Renders the batch being filled and starts reading it back
+static void flush_batch(FrameCapture* capture)
+{
+    unsigned int slot = (capture->oldest + capture->in_flight) % CAPTURE_RING_SIZE;
+    ++capture->in_flight;
+
+    CaptureBatch* batch = &capture->batches[slot];
+    RenderState* render_state = capture->render_state;
+    auto start = std::chrono::steady_clock::now();
+    if (render_state->renderer == RENDERER_CPU)
+    {
+        for (unsigned int i = 0; i < batch->count; ++i)
+        {
+            ProfileTimer timer(STAGE_RENDER);
+            render_frame_cpu(batch->states[i], &batch->pixels[i * frame_pixels(render_state)], render_state->camera_width, render_state->camera_height);
+        }
+        return;
+    }
+
+    render_batch(*render_state, batch->states.data(), batch->count, render_state->camera_width, render_state->camera_height);
+
+    // With a pack buffer bound this returns straight away, the copy happens
+    // whenever the GPU gets to it
+    unsigned int columns, rows;
+    render_atlas_size(*render_state, batch->count, &columns, &rows);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, batch->pbo);
+    glReadPixels(
+        0, 0,
+        columns * render_state->camera_width, rows * render_state->camera_height,
+        GL_RED,             // we want a grayscale image
+        GL_UNSIGNED_SHORT,  // and 16-bit pixel values
+        0);                 // offset into the pack buffer
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    batch->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    // Shared out evenly, so every frame has one render time. With GL this is
+    // only the time to issue the commands, the GPU's time ends up in readback.
+    if (profile_enabled)
+    {
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+        for (unsigned int i = 0; i < batch->count; ++i)
+        {
+            profile_record(STAGE_RENDER, elapsed.count() / batch->count);
+        }
+    }
+}
+
+void capture_submit(FrameCapture* capture, const SimulationState& state, unsigned int index)
+{
+    unsigned int slot = (capture->oldest + capture->in_flight) % CAPTURE_RING_SIZE;
+    CaptureBatch* batch = &capture->batches[slot];
+    batch->indices[batch->count] = index;
+    batch->states[batch->count] = state;
+    ++batch->count;
+
+    if (batch->count == capture->batch_size)
+    {
+        flush_batch(capture);
+    }
+}
+
+void capture_retrieve(FrameCapture* capture, CapturedFrame* frame)
+{
+    if (capture->in_flight == 0)
+    {
+        flush_batch(capture);
+    }
+
+    ProfileTimer timer(STAGE_READBACK);
+
+    const RenderState* render_state = capture->render_state;
+    uint32_t width = render_state->camera_width;
+    uint32_t height = render_state->camera_height;
+
+    CaptureBatch* batch = &capture->batches[capture->oldest];
+    unsigned int i = batch->retrieved;
+    frame->index = batch->indices[i];
+    frame->state = batch->states[i];
+    frame->width = width;
+    frame->height = height;
+    frame->cached = false;
+    frame->pixels.resize(frame_pixels(render_state));
+
+    if (render_state->renderer == RENDERER_CPU)
+    {
+        copy_flipped(frame->pixels.data(), &batch->pixels[i * frame_pixels(render_state)], width, height, width);
+    }
+    else
+    {
+        unsigned int columns, rows;
+        render_atlas_size(*render_state, batch->count, &columns, &rows);
+
+        if (!batch->mapped)
+        {
+            // The first wait flushes so the fence is guaranteed to signal eventually
+            GLbitfield wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            const GLuint64 one_second = 1000000000;
+            while (glClientWaitSync(batch->fence, wait_flags, one_second) == GL_TIMEOUT_EXPIRED)
+            {
+                wait_flags = 0;
+            }
+            glDeleteSync(batch->fence);
+            batch->fence = 0;
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, batch->pbo);
+            batch->mapped = (const uint16_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, columns * rows * frame_pixels(render_state) * sizeof(uint16_t), GL_MAP_READ_BIT);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        size_t atlas_width = columns * width;
+        const uint16_t* tile = batch->mapped + (i / columns) * height * atlas_width + (i % columns) * width;
+        copy_flipped(frame->pixels.data(), tile, width, height, atlas_width);
+    }
+
+    ++batch->retrieved;
+    if (batch->retrieved == batch->count)
+    {
+        if (batch->mapped)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, batch->pbo);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            batch->mapped = nullptr;
+        }
+        batch->count = 0;
+        batch->retrieved = 0;
+        capture->oldest = (capture->oldest + 1) % CAPTURE_RING_SIZE;
+        --capture->in_flight;
+    }
+}
+
+void capture_frame(RenderState* render_state, const SimulationState& state, CapturedFrame* frame)
+{
+    FrameCapture capture;
+    capture_init(&capture, render_state);
+    capture_submit(&capture, state, 0);
+    capture_retrieve(&capture, frame);
+    capture_cleanup(&capture);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "rendering.h"
+#include "sim.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Number of batches that can be in flight between capture_submit and capture_retrieve
+#define CAPTURE_RING_SIZE 3
+
+// A frame rendered at the camera resolution, top row first, together with the
+// state it was rendered from. All of the export formats are made from this.
+// The pixels are sized by capture_retrieve, and frames are reused, so they're
+// only allocated once per frame in the output queue.
+struct CapturedFrame
+{
+    unsigned int index = 0;
+    SimulationState state;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint16_t> pixels;
+
+    // Loaded from the render cache (see render_cache.h) rather than rendered
+    bool cached = false;
+};
+
+// A group of frames rendered together and read back with one transfer
+struct CaptureBatch
+{
+    GLuint pbo = 0;
+    GLsync fence = 0;
+
+    // Frames submitted to this batch so far, and how many of them
+    // capture_retrieve has already handed out
+    unsigned int count = 0;
+    unsigned int retrieved = 0;
+
+    // Index and state of each frame
+    std::vector<unsigned int> indices;
+    std::vector<SimulationState> states;
+
+    // The CPU renderer renders straight into this, one frame after another
+    std::vector<uint16_t> pixels;
+
+    // Readback of the atlas, mapped while frames are being retrieved from it
+    const uint16_t* mapped = nullptr;
+};
+
+// Renders frames and reads them back asynchronously.
+// With the GL renderers the readback goes through a ring of pixel buffer
+// objects, so the next frames can be drawn while earlier ones are still being
+// copied off the GPU. With batch_size above 1 (offscreen only), frames are
+// collected until there are batch_size of them, then drawn into an atlas with
+// render_batch and read back together.
+struct FrameCapture
+{
+    RenderState* render_state = nullptr;
+    unsigned int batch_size = 1;
+
+    CaptureBatch batches[CAPTURE_RING_SIZE];
+
+    // Batches that have been drawn, oldest first, followed by the one being
+    // filled by capture_submit
+    unsigned int oldest = 0;
+    unsigned int in_flight = 0;
+};
+
+// batch_size is clamped to render_state->batch_max, and to 1 for anything
+// but the offscreen renderer
+void capture_init(FrameCapture* capture, RenderState* render_state, unsigned int batch_size = 1);
+void capture_cleanup(FrameCapture* capture);
+
+bool capture_full(const FrameCapture* capture);
+bool capture_empty(const FrameCapture* capture);
+
+// Adds `state` to the current batch, and if that fills it, renders the batch
+// and starts reading it back. The ring must not be full.
+void capture_submit(FrameCapture* capture, const SimulationState& state, unsigned int index);
+
+// Waits for the oldest submitted frame to finish reading back and copies it
+// into `frame`, flipping it so the top row comes first. A batch that isn't
+// full yet is rendered first if it holds the oldest frame. The ring must not
+// be empty.
+void capture_retrieve(FrameCapture* capture, CapturedFrame* frame);
+
+// Renders and reads back a single frame
+void capture_frame(RenderState* render_state, const SimulationState& state, CapturedFrame* frame);
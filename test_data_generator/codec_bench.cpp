@@ -0,0 +1,141 @@
+// Measures the lossless frame codec (ircodec.h) on .hrzpack datasets.
+//
+// Usage: ./codec_bench <dataset.hrzpack>...
+//
+// Every frame is compressed, decoded again one row at a time and checked
+// against the original. Prints the compression ratio against a uint16 per
+// pixel (packed .b14 frames are 8/7) and the encode and decode speeds in MB
+// of uint16 frames per second, overall and by how noisy the frames are.
+
+#include "dataset.h"
+#include "ircodec.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+struct CodecTotals
+{
+    uint64_t frames = 0;
+    uint64_t raw_bytes = 0;
+    uint64_t compressed_bytes = 0;
+    double encode_seconds = 0.0;
+    double decode_seconds = 0.0;
+};
+
+// Buckets of noise_stdev (a fraction of full scale)
+static const float NOISE_BUCKETS[] = {0.01f, 0.05f, 0.1f};
+static const unsigned int NOISE_BUCKET_COUNT = sizeof(NOISE_BUCKETS) / sizeof(*NOISE_BUCKETS) + 1;
+
+static void print_totals(const char* label, const CodecTotals& totals)
+{
+    if (totals.frames == 0)
+    {
+        return;
+    }
+    cout << label << ": " << totals.frames << " frames, ratio " << (double)totals.raw_bytes / totals.compressed_bytes
+         << " (" << 8.0 * totals.compressed_bytes / (totals.raw_bytes / 2) << " bits/pixel), encode "
+         << totals.raw_bytes / totals.encode_seconds / 1e6 << " MB/s, decode "
+         << totals.raw_bytes / totals.decode_seconds / 1e6 << " MB/s" << endl;
+}
+
+int main(int argc, char** args)
+{
+    if (argc < 2)
+    {
+        cout << "Usage: ./codec_bench <dataset.hrzpack>..." << endl;
+        return 1;
+    }
+
+    CodecTotals all;
+    CodecTotals by_noise[NOISE_BUCKET_COUNT];
+
+    for (int i = 1; i < argc; ++i)
+    {
+        DatasetReader reader;
+        if (dataset_open(&reader, args[i]) != 0)
+        {
+            return 1;
+        }
+
+        uint32_t width = reader.header->frame_width;
+        uint32_t height = reader.header->frame_height;
+        size_t pixels = (size_t)width * height;
+        std::vector<uint8_t> compressed(IRC_MAX_BYTES(pixels));
+        std::vector<uint16_t> decoded(pixels);
+
+        for (uint64_t slot = 0; slot < dataset_count(&reader); ++slot)
+        {
+            const uint16_t* frame = dataset_frame(&reader, slot);
+
+            // Older datasets have shorter states, sim.h keeps the defaults
+            // for the fields they don't have
+            SimulationState state;
+            memcpy(&state, dataset_state(&reader, slot), std::min<size_t>(reader.header->state_size, sizeof(state)));
+
+            auto start = std::chrono::steady_clock::now();
+            size_t size = irc_encode(frame, width, height, state.bit_depth, compressed.data(), compressed.size());
+            auto encoded = std::chrono::steady_clock::now();
+
+            IrcDecoder decoder;
+            bool ok = size != 0 && irc_decoder_init(&decoder, compressed.data(), size) == 0;
+            for (uint32_t y = 0; ok && y < height; ++y)
+            {
+                uint16_t* row = decoded.data() + (size_t)y * width;
+                ok = irc_decode_row(&decoder, y ? row - width : nullptr, row) == 0;
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            if (!ok || memcmp(decoded.data(), frame, pixels * sizeof(uint16_t)) != 0)
+            {
+                cerr << args[i] << " slot " << slot << " didn't survive the round trip" << endl;
+                dataset_close(&reader);
+                return 1;
+            }
+
+            unsigned int bucket = 0;
+            while (bucket < NOISE_BUCKET_COUNT - 1 && state.noise_stdev >= NOISE_BUCKETS[bucket])
+            {
+                ++bucket;
+            }
+            for (CodecTotals* totals : {&all, &by_noise[bucket]})
+            {
+                totals->frames++;
+                totals->raw_bytes += pixels * sizeof(uint16_t);
+                totals->compressed_bytes += size;
+                totals->encode_seconds += std::chrono::duration<double>(encoded - start).count();
+                totals->decode_seconds += std::chrono::duration<double>(end - encoded).count();
+            }
+        }
+
+        dataset_close(&reader);
+    }
+
+    print_totals("all", all);
+    for (unsigned int bucket = 0; bucket < NOISE_BUCKET_COUNT; ++bucket)
+    {
+        std::string label = "noise_stdev ";
+        if (bucket == 0)
+        {
+            label += "< " + std::to_string(NOISE_BUCKETS[0]).substr(0, 4);
+        }
+        else if (bucket == NOISE_BUCKET_COUNT - 1)
+        {
+            label += ">= " + std::to_string(NOISE_BUCKETS[bucket - 1]).substr(0, 4);
+        }
+        else
+        {
+            label += std::to_string(NOISE_BUCKETS[bucket - 1]).substr(0, 4) + " to " + std::to_string(NOISE_BUCKETS[bucket]).substr(0, 4);
+        }
+        print_totals(label.c_str(), by_noise[bucket]);
+    }
+    return 0;
+}
@@ -0,0 +1,207 @@
+// Prints the range and mean of every column of a .hrzcol file (see
+// columns.h), or just the named ones.
+//
+// Usage: ./column_stats <file.hrzcol> [column...]
+//
+// Each column is scanned where it's mapped, without touching the others.
+// For example `./column_stats test.hrzcol altitude nadir` only reads the
+// altitude and nadir arrays.
+
+#include "columns.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+struct ComponentStats
+{
+    double min = INFINITY;
+    double max = -INFINITY;
+    double sum = 0.0;
+};
+
+template <typename T>
+static void scan(const T* values, uint64_t count, uint32_t components, ComponentStats* stats)
+{
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        for (uint32_t c = 0; c < components; ++c)
+        {
+            double value = values[i * components + c];
+            stats[c].min = std::min(stats[c].min, value);
+            stats[c].max = std::max(stats[c].max, value);
+            stats[c].sum += value;
+        }
+    }
+}
+
+// Scalar float columns are the common case (altitude, noise_stdev, ...), so
+// they get four lanes at a time. The sum is kept in doubles so the mean
+// doesn't depend on the number of samples much.
+static void scan_f32(const float* values, uint64_t count, ComponentStats* stats)
+{
+    uint64_t i = 0;
+#ifdef __SSE2__
+    if (count >= 4)
+    {
+        __m128 min = _mm_loadu_ps(values);
+        __m128 max = min;
+        __m128d sum_low = _mm_setzero_pd();
+        __m128d sum_high = _mm_setzero_pd();
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 v = _mm_loadu_ps(values + i);
+            min = _mm_min_ps(min, v);
+            max = _mm_max_ps(max, v);
+            sum_low = _mm_add_pd(sum_low, _mm_cvtps_pd(v));
+            sum_high = _mm_add_pd(sum_high, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+        }
+
+        float lanes_min[4], lanes_max[4];
+        double lanes_sum[2];
+        _mm_storeu_ps(lanes_min, min);
+        _mm_storeu_ps(lanes_max, max);
+        _mm_storeu_pd(lanes_sum, _mm_add_pd(sum_low, sum_high));
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            stats->min = std::min(stats->min, (double)lanes_min[lane]);
+            stats->max = std::max(stats->max, (double)lanes_max[lane]);
+        }
+        stats->sum += lanes_sum[0] + lanes_sum[1];
+    }
+#endif
+    scan(values + i, count - i, 1, stats);
+}
+
+static const char* type_name(ColumnType type)
+{
+    switch (type)
+    {
+        case COLUMN_U8: return "u8";
+        case COLUMN_I16: return "i16";
+        case COLUMN_I32: return "i32";
+        case COLUMN_U32: return "u32";
+        case COLUMN_U64: return "u64";
+        case COLUMN_F32: return "f32";
+    }
+    return "?";
+}
+
+static void print_column(const ColumnsReader* reader, const ColumnDescriptor* column)
+{
+    uint64_t count = columns_count(reader);
+    const void* data = reader->data + column->offset;
+    ColumnType type = (ColumnType)column->type;
+
+    cout << column->name << " (" << type_name(type);
+    if (column->components > 1)
+    {
+        cout << " x " << column->components;
+    }
+    cout << ")";
+
+    if (type == COLUMN_U8)
+    {
+        // Text, like sensor_name. Only the first sample's is shown.
+        if (count > 0)
+        {
+            cout << " first: \"" << std::string((const char*)data, strnlen((const char*)data, column->components)) << "\"";
+        }
+        cout << endl;
+        return;
+    }
+    cout << endl;
+
+    std::vector<ComponentStats> stats(column->components);
+    switch (type)
+    {
+        case COLUMN_I16: scan((const int16_t*)data, count, column->components, stats.data()); break;
+        case COLUMN_I32: scan((const int32_t*)data, count, column->components, stats.data()); break;
+        case COLUMN_U32: scan((const uint32_t*)data, count, column->components, stats.data()); break;
+        case COLUMN_U64: scan((const uint64_t*)data, count, column->components, stats.data()); break;
+        case COLUMN_F32:
+            if (column->components == 1)
+            {
+                scan_f32((const float*)data, count, stats.data());
+            }
+            else
+            {
+                scan((const float*)data, count, column->components, stats.data());
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (count == 0)
+    {
+        return;
+    }
+    for (uint32_t c = 0; c < column->components; ++c)
+    {
+        cout << "  ";
+        if (column->components > 1)
+        {
+            cout << "[" << c << "] ";
+        }
+        cout << "min " << stats[c].min << " max " << stats[c].max << " mean " << stats[c].sum / count << endl;
+    }
+}
+
+int main(int argc, char** args)
+{
+    if (argc < 2)
+    {
+        cout << "Usage: ./column_stats <file.hrzcol> [column...]" << endl;
+        return 1;
+    }
+
+    ColumnsReader reader;
+    if (columns_open(&reader, args[1]) != 0)
+    {
+        return 1;
+    }
+
+    cout << args[1] << ": " << columns_count(&reader) << " samples, " << reader.header->column_count
+         << " columns, schema version " << reader.header->schema_version << endl;
+
+    auto start = std::chrono::steady_clock::now();
+    if (argc == 2)
+    {
+        for (uint32_t i = 0; i < reader.header->column_count; ++i)
+        {
+            print_column(&reader, &reader.directory[i]);
+        }
+    }
+    else
+    {
+        for (int i = 2; i < argc; ++i)
+        {
+            const ColumnDescriptor* column = columns_find(&reader, args[i]);
+            if (!column)
+            {
+                cerr << args[1] << " has no column " << args[i] << endl;
+                columns_close(&reader);
+                return 1;
+            }
+            print_column(&reader, column);
+        }
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    cout << "Scanned in " << seconds.count() * 1e3 << " ms" << endl;
+
+    columns_close(&reader);
+    return 0;
+}
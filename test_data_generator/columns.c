@@ -0,0 +1,255 @@
+#include "columns.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t column_type_size(ColumnType type)
+{
+    switch (type)
+    {
+        case COLUMN_U8:
+            return 1;
+        case COLUMN_I16:
+            return 2;
+        case COLUMN_I32:
+        case COLUMN_U32:
+        case COLUMN_F32:
+            return 4;
+        case COLUMN_U64:
+            return 8;
+    }
+    return 0;
+}
+
+int columns_create(ColumnsWriter* writer, const char* filename, uint32_t schema_version,
+                   const ColumnSpec* specs, uint32_t column_count, uint64_t count)
+{
+    memset(writer, 0, sizeof(*writer));
+
+    uint64_t directory_offset = COLUMNS_ALIGNMENT;
+    uint64_t offset = align_up(directory_offset + column_count * sizeof(ColumnDescriptor), COLUMNS_ALIGNMENT);
+    for (uint32_t i = 0; i < column_count; ++i)
+    {
+        offset = align_up(offset + count * specs[i].components * column_type_size(specs[i].type), COLUMNS_ALIGNMENT);
+    }
+    // An empty run still gets its header and directory
+    uint64_t file_size = offset;
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    // The file is written through the mapping, so writer threads only copy
+    // their values in. Its blocks are allocated up front, since running out
+    // of space while storing through a mapping is a SIGBUS rather than an
+    // error.
+    void* data = MAP_FAILED;
+    int error = posix_fallocate(fd, 0, file_size);
+    if (error == 0)
+    {
+        data = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    else
+    {
+        errno = error;
+    }
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    writer->data = (uint8_t*)data;
+    writer->size = file_size;
+    writer->header = (ColumnsHeader*)data;
+    writer->directory = (ColumnDescriptor*)(writer->data + directory_offset);
+
+    // The header goes in without the complete flag, so an interrupted run
+    // leaves a file readers will refuse
+    ColumnsHeader* header = writer->header;
+    memcpy(header->magic, COLUMNS_MAGIC, sizeof(COLUMNS_MAGIC));
+    header->version = COLUMNS_VERSION;
+    header->schema_version = schema_version;
+    header->column_count = column_count;
+    header->count = count;
+    header->directory_offset = directory_offset;
+
+    offset = align_up(directory_offset + column_count * sizeof(ColumnDescriptor), COLUMNS_ALIGNMENT);
+    for (uint32_t i = 0; i < column_count; ++i)
+    {
+        ColumnDescriptor* column = &writer->directory[i];
+        strncpy(column->name, specs[i].name, COLUMNS_NAME_LENGTH - 1);
+        column->type = specs[i].type;
+        column->components = specs[i].components;
+        column->offset = offset;
+        column->size = count * specs[i].components * column_type_size(specs[i].type);
+        offset = align_up(offset + column->size, COLUMNS_ALIGNMENT);
+    }
+
+    return 0;
+}
+
+void* columns_value(ColumnsWriter* writer, uint32_t column, uint64_t slot)
+{
+    if (column >= writer->header->column_count || slot >= writer->header->count)
+    {
+        __atomic_store_n(&writer->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    const ColumnDescriptor* descriptor = &writer->directory[column];
+    size_t value_size = descriptor->components * column_type_size((ColumnType)descriptor->type);
+    return writer->data + descriptor->offset + slot * value_size;
+}
+
+int columns_finish(ColumnsWriter* writer)
+{
+    // Values that weren't written would read as zeros, so the file stays as
+    // an interrupted run would leave it
+    if (__atomic_load_n(&writer->failed, __ATOMIC_RELAXED))
+    {
+        munmap(writer->data, writer->size);
+        memset(writer, 0, sizeof(*writer));
+        fprintf(stderr, "The column file is missing values, so it isn't marked complete\n");
+        return -1;
+    }
+
+    writer->header->flags |= COLUMNS_FLAG_COMPLETE;
+    int result = msync(writer->data, writer->size, MS_SYNC);
+    if (munmap(writer->data, writer->size) != 0)
+    {
+        result = -1;
+    }
+    memset(writer, 0, sizeof(*writer));
+
+    if (result != 0)
+    {
+        perror("Finishing column file");
+    }
+    return result;
+}
+
+int columns_open(ColumnsReader* reader, const char* filename)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(ColumnsHeader))
+    {
+        fprintf(stderr, "%s is too small to be a column file\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    reader->data = (const uint8_t*)data;
+    reader->size = file_stat.st_size;
+    reader->header = (const ColumnsHeader*)data;
+    reader->directory = (const ColumnDescriptor*)(reader->data + reader->header->directory_offset);
+
+    const ColumnsHeader* header = reader->header;
+    const char* problem = NULL;
+    if (memcmp(header->magic, COLUMNS_MAGIC, sizeof(COLUMNS_MAGIC)) != 0)
+    {
+        problem = "is not a column file";
+    }
+    else if (header->version != COLUMNS_VERSION)
+    {
+        problem = "is from an incompatible version";
+    }
+    else if (!(header->flags & COLUMNS_FLAG_COMPLETE))
+    {
+        problem = "was never finished";
+    }
+    else if (header->directory_offset + header->column_count * sizeof(ColumnDescriptor) > reader->size)
+    {
+        problem = "is truncated";
+    }
+    else
+    {
+        for (uint32_t i = 0; i < header->column_count; ++i)
+        {
+            const ColumnDescriptor* column = &reader->directory[i];
+            if (column->offset + column->size > reader->size
+                || column->size != header->count * column->components * column_type_size((ColumnType)column->type))
+            {
+                problem = "is truncated";
+                break;
+            }
+        }
+    }
+
+    if (problem)
+    {
+        fprintf(stderr, "%s %s\n", filename, problem);
+        columns_close(reader);
+        return -1;
+    }
+
+    return 0;
+}
+
+void columns_close(ColumnsReader* reader)
+{
+    if (reader->data)
+    {
+        munmap((void*)reader->data, reader->size);
+    }
+    memset(reader, 0, sizeof(*reader));
+}
+
+uint64_t columns_count(const ColumnsReader* reader)
+{
+    return reader->header->count;
+}
+
+const ColumnDescriptor* columns_find(const ColumnsReader* reader, const char* name)
+{
+    for (uint32_t i = 0; i < reader->header->column_count; ++i)
+    {
+        const ColumnDescriptor* column = &reader->directory[i];
+        if (strncmp(column->name, name, COLUMNS_NAME_LENGTH) == 0)
+        {
+            return column;
+        }
+    }
+    return NULL;
+}
+
+const void* columns_data(const ColumnsReader* reader, const char* name, ColumnType type, uint32_t components)
+{
+    const ColumnDescriptor* column = columns_find(reader, name);
+    if (!column || column->type != (uint32_t)type || column->components != components)
+    {
+        return NULL;
+    }
+    return reader->data + column->offset;
+}
@@ -0,0 +1,137 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+// Columnar sample metadata (.hrzcol)
+//
+// The same per-sample parameters as the .hrz files, but stored as one array
+// per field across the whole run, so a tool looking at one field maps and
+// scans one contiguous array instead of opening a file per sample.
+// Everything is little-endian:
+//
+//   offset 0             ColumnsHeader, padded to COLUMNS_ALIGNMENT
+//   directory_offset     ColumnDescriptor[column_count]
+//   column offsets       count values of each column, `components` elements
+//                        of `type` per value, one column after another
+//
+// Columns start on a COLUMNS_ALIGNMENT boundary, so each one can be mapped,
+// advised or paged in on its own. Value i of every column belongs to the
+// same sample.
+//
+// Readers find columns by name, and get nothing back if the type or number
+// of components isn't what they expect, so a field changing shape can't be
+// misread the way a changed struct layout can. schema_version is the version
+// of whatever set of columns the writer uses (STATE_COLUMNS_VERSION for the
+// generator), and goes up when a column changes meaning without changing
+// shape.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COLUMNS_MAGIC "HRZCOLS"
+#define COLUMNS_VERSION 1
+#define COLUMNS_ALIGNMENT 4096
+#define COLUMNS_NAME_LENGTH 32
+
+// Set once every value has been written. Files without it were interrupted.
+#define COLUMNS_FLAG_COMPLETE 1
+
+typedef enum
+{
+    COLUMN_U8 = 1,
+    COLUMN_I16 = 2,
+    COLUMN_I32 = 3,
+    COLUMN_U32 = 4,
+    COLUMN_U64 = 5,
+    COLUMN_F32 = 6,
+} ColumnType;
+
+#pragma pack(push, 1)
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t schema_version;
+    uint32_t column_count;
+    uint64_t count;
+    uint64_t directory_offset;
+} ColumnsHeader;
+
+typedef struct
+{
+    char name[COLUMNS_NAME_LENGTH];
+    uint32_t type;          // ColumnType
+    uint32_t components;    // elements per value, e.g. 3 for a vector
+    uint64_t offset;
+    uint64_t size;          // bytes, count * components * element size
+} ColumnDescriptor;
+#pragma pack(pop)
+
+// What a writer is asked to make
+typedef struct
+{
+    const char* name;
+    ColumnType type;
+    uint32_t components;
+} ColumnSpec;
+
+typedef struct
+{
+    uint8_t* data;
+    size_t size;
+    ColumnsHeader* header;
+    ColumnDescriptor* directory;
+
+    // Set when a value couldn't be written, so columns_finish leaves the
+    // file incomplete. Only accessed atomically, like DatasetWriter's.
+    int failed;
+} ColumnsWriter;
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t size;
+    const ColumnsHeader* header;
+    const ColumnDescriptor* directory;
+} ColumnsReader;
+
+// Bytes in one element of `type`
+size_t column_type_size(ColumnType type);
+
+// Creates a file with room for `count` values of each column in `specs`.
+// Returns 0 on success.
+int columns_create(ColumnsWriter* writer, const char* filename, uint32_t schema_version,
+                   const ColumnSpec* specs, uint32_t column_count, uint64_t count);
+
+// Where value `slot` of column `column` (its position in `specs`) goes, or
+// NULL (and the writer fails) if there's no such slot. Values can be written
+// in any order and from several threads at once.
+void* columns_value(ColumnsWriter* writer, uint32_t column, uint64_t slot);
+
+// Marks the file complete and closes it. Returns 0 on success, or -1 without
+// marking it complete if any value couldn't be written.
+int columns_finish(ColumnsWriter* writer);
+
+// Maps a column file. Returns 0 on success.
+int columns_open(ColumnsReader* reader, const char* filename);
+void columns_close(ColumnsReader* reader);
+
+uint64_t columns_count(const ColumnsReader* reader);
+
+// The column called `name`, or NULL if there isn't one
+const ColumnDescriptor* columns_find(const ColumnsReader* reader, const char* name);
+
+// Pointer straight into the mapping to the first value of the column called
+// `name`, or NULL if there isn't one with that type and number of
+// components
+const void* columns_data(const ColumnsReader* reader, const char* name, ColumnType type, uint32_t components);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // include guard
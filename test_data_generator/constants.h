@@ -11,6 +11,12 @@
 
 #define EARTH_RADIUS 6371.0
 
+// km^3/s^2
+#define EARTH_GRAVITATIONAL_PARAMETER 398600.4418
+
+// Sidereal, in rad/s
+#define EARTH_ROTATION_RATE 7.2921159e-5
+
 
 
 /************
@@ -37,18 +43,25 @@
 
 #define DEFAULT_LENS_DIST 0.0
 
+// Orbit for --trajectory, in degrees. This is the ISS's, which passes over
+// the default latitude.
+#define DEFAULT_INCLINATION 51.6
+
 /********************
  * Hardware Details *
  ********************/
 
-#define CAMERA_WIDTH 160
-#define CAMERA_HEIGHT 120
-
-// 57 degrees in radians
-#define HORIZONTAL_FOV 57.0 * M_PI / 180.0
+// The Lepton 3.5 on the board, the default sensor profile (see sensor.h)
+#define LEPTON_WIDTH 160
+#define LEPTON_HEIGHT 120
+#define LEPTON_HORIZONTAL_FOV 57.0
+#define LEPTON_BIT_DEPTH 14
 
 #define MAGNETIC_FIELD_SENSITIVITY 0.14
 
+// Frames per second from the Lepton
+#define LEPTON_FRAME_RATE 8.7
+
 /**********
  * Bounds *
  **********/
@@ -0,0 +1,206 @@
+// Packs a directory of .b14/.hrz, .bin/.hrz or .irc/.hrz pairs exported by
+// the test image generator into a single .hrzpack dataset (see dataset.h).
+// Packed .b14 and compressed .irc frames are expanded, datasets always hold a
+// uint16 per pixel so they can be mapped and read in place.
+//
+// Usage: ./convert_dataset <output.hrzpack> <directory> [output.hrzcol]
+//
+// The directory is searched recursively. Samples are stored in order of the
+// number at the end of their filename (test12.bin is sample 12), which is the
+// fuzz run index for files made with --export. The .png files are ignored,
+// they're just an 8-bit copy of the frame. The frame size comes from the
+// sensor in the first sample's .hrz, and every sample has to match it; .hrz
+// files from before sensor profiles are Lepton frames.
+//
+// With a third filename the states are also written as a column file (see
+// columns.h), for looking at the parameters of an old dataset without
+// opening every .hrz again.
+
+#include "dataset.h"
+#include "ircodec.h"
+#include "pack14.h"
+#include "sim.h"
+#include "state_columns.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+namespace fs = std::filesystem;
+
+struct Sample
+{
+    fs::path raw_path;    // .b14, .bin or .irc
+    uint64_t index;
+};
+
+// Number at the end of the filename stem, or -1 if there isn't one
+static long long trailing_number(const fs::path& path)
+{
+    std::string stem = path.stem().string();
+    size_t digits_start = stem.size();
+    while (digits_start > 0 && isdigit((unsigned char)stem[digits_start - 1]))
+    {
+        --digits_start;
+    }
+    if (digits_start == stem.size())
+    {
+        return -1;
+    }
+    return std::stoll(stem.substr(digits_start));
+}
+
+int main(int argc, char** args)
+{
+    if (argc != 3 && argc != 4)
+    {
+        cout << "Usage: ./convert_dataset <output.hrzpack> <directory> [output.hrzcol]" << endl;
+        return 1;
+    }
+
+    std::vector<Sample> samples;
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator(args[2]))
+    {
+        if (entry.is_regular_file() && (entry.path().extension() == ".b14" || entry.path().extension() == ".bin"
+                                         || entry.path().extension() == ".irc"))
+        {
+            long long number = trailing_number(entry.path());
+            if (number < 0)
+            {
+                cerr << "Skipping " << entry.path() << ", its name doesn't end in a sample number" << endl;
+                continue;
+            }
+            samples.push_back({entry.path(), (uint64_t)number});
+        }
+    }
+
+    std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b)
+    {
+        return a.index < b.index;
+    });
+    for (size_t i = 1; i < samples.size(); ++i)
+    {
+        if (samples[i].index == samples[i - 1].index)
+        {
+            cerr << samples[i - 1].raw_path << " and " << samples[i].raw_path << " have the same sample number" << endl;
+            return 1;
+        }
+    }
+
+    if (samples.empty())
+    {
+        cerr << "No samples in " << args[2] << endl;
+        return 1;
+    }
+
+    ColumnsWriter columns;
+    const char* columns_filename = argc == 4 ? args[3] : nullptr;
+    if (columns_filename && state_columns_create(&columns, columns_filename, samples.size()) != 0)
+    {
+        return 1;
+    }
+
+    DatasetWriter writer;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint16_t> frame;
+    std::vector<uint8_t> file_data;
+
+    for (size_t slot = 0; slot < samples.size(); ++slot)
+    {
+        const Sample& sample = samples[slot];
+
+        fs::path hrz_path = sample.raw_path;
+        hrz_path.replace_extension(".hrz");
+        SimulationState state;
+        if (!state.load_state(hrz_path.c_str()))
+        {
+            cerr << "Couldn't load " << hrz_path << endl;
+            return 1;
+        }
+
+        if (slot == 0)
+        {
+            width = state.sensor_width;
+            height = state.sensor_height;
+            frame.resize((size_t)width * height);
+            if (dataset_create(&writer, args[1], width, height, sizeof(SimulationState), samples.size()) != 0)
+            {
+                return 1;
+            }
+        }
+        else if (state.sensor_width != width || state.sensor_height != height)
+        {
+            cerr << hrz_path << " is from a " << state.sensor_width << "x" << state.sensor_height
+                 << " sensor, the rest are " << width << "x" << height << endl;
+            return 1;
+        }
+
+        std::ifstream raw_file(sample.raw_path, std::ios::binary | std::ios::ate);
+        size_t file_size = raw_file.tellg();
+        raw_file.seekg(0);
+        if (sample.raw_path.extension() == ".irc")
+        {
+            // Compressed frames are whatever size they came out as, the
+            // header says what's in them
+            file_data.resize(file_size);
+            raw_file.read((char*)file_data.data(), file_size);
+            const IrcHeader* header = (const IrcHeader*)file_data.data();
+            if (file_size < sizeof(IrcHeader) || header->width != width || header->height != height
+                || irc_decode(file_data.data(), file_size, frame.data()) != 0)
+            {
+                cerr << sample.raw_path << " isn't a " << width << "x" << height << " compressed frame" << endl;
+                return 1;
+            }
+        }
+        else if (sample.raw_path.extension() == ".b14")
+        {
+            if (file_size != PACK14_BYTES(frame.size()))
+            {
+                cerr << sample.raw_path << " isn't a " << width << "x" << height << " frame" << endl;
+                return 1;
+            }
+            file_data.resize(file_size);
+            raw_file.read((char*)file_data.data(), file_size);
+            unpack14(file_data.data(), frame.data(), frame.size());
+        }
+        else
+        {
+            if (file_size != frame.size() * sizeof(uint16_t))
+            {
+                cerr << sample.raw_path << " isn't a " << width << "x" << height << " frame" << endl;
+                return 1;
+            }
+            raw_file.read((char*)frame.data(), file_size);
+        }
+
+        if (dataset_write(&writer, slot, sample.index, frame.data(), &state) != 0)
+        {
+            return 1;
+        }
+        if (columns_filename && state_columns_write(&columns, slot, sample.index, state) != 0)
+        {
+            return 1;
+        }
+    }
+
+    if (dataset_finish(&writer) != 0)
+    {
+        return 1;
+    }
+    if (columns_filename && columns_finish(&columns) != 0)
+    {
+        return 1;
+    }
+
+    cout << "Packed " << samples.size() << " samples into " << args[1] << endl;
+    return 0;
+}
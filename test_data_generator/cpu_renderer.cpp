@@ -0,0 +1,114 @@
+#include "cpu_renderer.h"
+#include "distortion.h"
+#include "noise.h"
+
+#include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Everything in the shader that doesn't depend on the pixel
+struct ShadeParams
+{
+    Vec3 nadir;
+    float alpha;
+    float alpha_atmosphere;
+    float ramp_scale;
+};
+
+// The pixel's ray comes from its DistortionTable
+static inline float shade_pixel(const ShadeParams& p, float ray_x, float ray_y, float ray_z, float noise)
+{
+    float d = p.nadir.x*ray_x + p.nadir.y*ray_y + p.nadir.z*ray_z;
+
+    float color = 0.0f;
+    if (d > p.alpha)
+    {
+        color = 0.5f;
+    }
+    else if (d > p.alpha_atmosphere)
+    {
+        color = (d - p.alpha_atmosphere) * p.ramp_scale;
+    }
+
+    color += noise;
+    color = fminf(fmaxf(color, 0.0f), 1.0f);
+    return color;
+}
+
+static inline uint16_t to_unorm16(float color)
+{
+    return static_cast<uint16_t>(lrintf(color * 65535.0f));
+}
+
+void render_frame_cpu(const SimulationState& state, uint16_t* pixels, uint32_t width, uint32_t height)
+{
+    ShadeParams p;
+    p.nadir = state.nadir;
+    p.alpha = cosf(asinf(EARTH_RADIUS / (EARTH_RADIUS + state.altitude)));
+    p.alpha_atmosphere = cosf(asinf((EARTH_RADIUS + state.visible_atmosphere_height) / (EARTH_RADIUS + state.altitude)));
+    p.ramp_scale = 0.5f / (p.alpha - p.alpha_atmosphere);
+
+    std::shared_ptr<const DistortionTable> distortion = distortion_table(state.K1, state.K2, state.horizontal_fov, width, height);
+
+    std::vector<float> noise_row(width);
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        uint32_t x = 0;
+        noise_fill((uint32_t)state.noise_seed, state.noise_stdev, noise_row.data(), y * width, width);
+        uint16_t* pixel_row = pixels + y * width;
+        const float* ray_x = distortion->ray_x() + y * width;
+        const float* ray_y = distortion->ray_y() + y * width;
+        const float* ray_z = distortion->ray_z() + y * width;
+
+#ifdef __SSE2__
+        // Four pixels of a row at a time. This is the scalar code above with
+        // the branches turned into masks.
+        const __m128 nadir_x = _mm_set1_ps(p.nadir.x);
+        const __m128 nadir_y = _mm_set1_ps(p.nadir.y);
+        const __m128 nadir_z = _mm_set1_ps(p.nadir.z);
+        const __m128 alpha = _mm_set1_ps(p.alpha);
+        const __m128 alpha_atmosphere = _mm_set1_ps(p.alpha_atmosphere);
+        const __m128 ramp_scale = _mm_set1_ps(p.ramp_scale);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 unorm_scale = _mm_set1_ps(65535.0f);
+
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128 d = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(nadir_x, _mm_loadu_ps(ray_x + x)),
+                _mm_mul_ps(nadir_y, _mm_loadu_ps(ray_y + x))),
+                _mm_mul_ps(nadir_z, _mm_loadu_ps(ray_z + x)));
+
+            __m128 in_earth = _mm_cmpgt_ps(d, alpha);
+            __m128 in_atmosphere = _mm_cmpgt_ps(d, alpha_atmosphere);
+            __m128 ramp = _mm_mul_ps(_mm_sub_ps(d, alpha_atmosphere), ramp_scale);
+
+            __m128 color = _mm_or_ps(
+                _mm_and_ps(in_earth, half),
+                _mm_andnot_ps(in_earth, _mm_and_ps(in_atmosphere, ramp)));
+
+            color = _mm_add_ps(color, _mm_loadu_ps(noise_row.data() + x));
+            color = _mm_min_ps(_mm_max_ps(color, zero), one);
+
+            // SSE2 has no unsigned 32 -> 16 bit pack, but values are at most
+            // 65535 so subtracting 32768 lets the signed pack do the job.
+            __m128i value = _mm_cvtps_epi32(_mm_mul_ps(color, unorm_scale));
+            value = _mm_sub_epi32(value, _mm_set1_epi32(32768));
+            value = _mm_packs_epi32(value, value);
+            value = _mm_xor_si128(value, _mm_set1_epi16((short)0x8000));
+            _mm_storel_epi64((__m128i*)(pixel_row + x), value);
+        }
+#endif
+
+        for (; x < width; ++x)
+        {
+            pixel_row[x] = to_unorm16(shade_pixel(p, ray_x[x], ray_y[x], ray_z[x], noise_row[x]));
+        }
+    }
+}
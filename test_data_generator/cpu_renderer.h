@@ -0,0 +1,20 @@
+#pragma once
+
+#include "sim.h"
+
+#include <stdint.h>
+
+// Software implementation of screen_shader.frag, for machines without a GPU.
+//
+// Pixels are written bottom row first, which is the same layout glReadnPixels
+// produces, so the export code can treat both renderers identically.
+// Noise is generated a row at a time with noise_fill, from the state's noise
+// seed and stdev, which is the same field the shader generates.
+//
+// Matching the GL renderers: every pixel is within half an 8-bit step
+// (128/65535) of RENDERER_GL, which reads back an 8-bit framebuffer, and
+// within 1 LSB of the 14-bit .bin output of RENDERER_GL_OFFSCREEN. Both take
+// their rays from the same DistortionTable and shade them with the same
+// operations, so they put the horizon and atmosphere edges in the same place.
+// See the README for measurements.
+void render_frame_cpu(const SimulationState& state, uint16_t* pixels, uint32_t width, uint32_t height);
@@ -0,0 +1,265 @@
+#include "dataset.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// DatasetWriter::failed is set by whichever writer threads fail, and read
+// once they're done
+#define SET_FAILED(writer) __atomic_store_n(&(writer)->failed, 1, __ATOMIC_RELAXED)
+#define HAS_FAILED(writer) __atomic_load_n(&(writer)->failed, __ATOMIC_RELAXED)
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static int write_all(int fd, const void* data, size_t size, uint64_t offset)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written <= 0)
+        {
+            return -1;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+int dataset_create(DatasetWriter* writer, const char* filename, uint32_t frame_width, uint32_t frame_height, uint32_t state_size, uint64_t count)
+{
+    DatasetHeader* header = &writer->header;
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, DATASET_MAGIC, sizeof(DATASET_MAGIC));
+    header->version = DATASET_VERSION;
+    header->frame_width = frame_width;
+    header->frame_height = frame_height;
+    header->bytes_per_pixel = sizeof(uint16_t);
+    header->state_size = state_size;
+    header->count = count;
+    writer->failed = 0;
+
+    // Strides are rounded up to cache lines so records never share one
+    header->frame_stride = align_up((uint64_t)frame_width * frame_height * sizeof(uint16_t), 64);
+    header->state_stride = align_up(state_size, 64);
+
+    header->index_offset = DATASET_ALIGNMENT;
+    header->frames_offset = align_up(header->index_offset + count * sizeof(DatasetIndexEntry), DATASET_ALIGNMENT);
+    header->states_offset = align_up(header->frames_offset + count * header->frame_stride, DATASET_ALIGNMENT);
+    uint64_t file_size = align_up(header->states_offset + count * header->state_stride, DATASET_ALIGNMENT);
+
+    writer->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    // The header goes in without the complete flag, so an interrupted run
+    // leaves a file readers will refuse
+    if (ftruncate(writer->fd, file_size) != 0
+        || write_all(writer->fd, header, sizeof(*header), 0) != 0)
+    {
+        perror(filename);
+        close(writer->fd);
+        writer->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int dataset_write(DatasetWriter* writer, uint64_t slot, uint64_t sample_index, const uint16_t* frame, const void* state)
+{
+    const DatasetHeader* header = &writer->header;
+    if (slot >= header->count)
+    {
+        SET_FAILED(writer);
+        return -1;
+    }
+
+    DatasetIndexEntry entry;
+    entry.sample_index = sample_index;
+    entry.frame_offset = header->frames_offset + slot * header->frame_stride;
+    entry.state_offset = header->states_offset + slot * header->state_stride;
+
+    size_t frame_size = (size_t)header->frame_width * header->frame_height * sizeof(uint16_t);
+    if (write_all(writer->fd, frame, frame_size, entry.frame_offset) != 0
+        || write_all(writer->fd, state, header->state_size, entry.state_offset) != 0
+        || write_all(writer->fd, &entry, sizeof(entry), header->index_offset + slot * sizeof(entry)) != 0)
+    {
+        perror("Writing dataset");
+        SET_FAILED(writer);
+        return -1;
+    }
+
+    return 0;
+}
+
+void dataset_fail(DatasetWriter* writer)
+{
+    SET_FAILED(writer);
+}
+
+int dataset_finish(DatasetWriter* writer)
+{
+    // A slot that failed to write leaves a hole readers can't see, so the
+    // file stays as an interrupted run would leave it
+    if (HAS_FAILED(writer))
+    {
+        close(writer->fd);
+        writer->fd = -1;
+        fprintf(stderr, "The dataset is missing samples, so it isn't marked complete\n");
+        return -1;
+    }
+
+    writer->header.flags |= DATASET_FLAG_COMPLETE;
+    int result = write_all(writer->fd, &writer->header, sizeof(writer->header), 0);
+    if (close(writer->fd) != 0)
+    {
+        result = -1;
+    }
+    writer->fd = -1;
+
+    if (result != 0)
+    {
+        perror("Finishing dataset");
+    }
+    return result;
+}
+
+// Whether `length` bytes from `offset` are inside a file of `size`, without
+// overflowing on offsets from a corrupt header
+static int in_file(uint64_t offset, uint64_t length, uint64_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+// Checks every index entry points at a whole frame and state inside the
+// file, so the accessors can't read outside the mapping
+static int index_in_file(const DatasetReader* reader)
+{
+    const DatasetHeader* header = reader->header;
+    uint64_t frame_pixels = (uint64_t)header->frame_width * header->frame_height;
+    if (frame_pixels > reader->size / sizeof(uint16_t))
+    {
+        return 0;
+    }
+    uint64_t frame_size = frame_pixels * sizeof(uint16_t);
+    for (uint64_t slot = 0; slot < header->count; ++slot)
+    {
+        const DatasetIndexEntry* entry = &reader->index[slot];
+        if (!in_file(entry->frame_offset, frame_size, reader->size)
+            || !in_file(entry->state_offset, header->state_size, reader->size))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int dataset_open(DatasetReader* reader, const char* filename)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(DatasetHeader))
+    {
+        fprintf(stderr, "%s is too small to be a dataset\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    reader->data = (const uint8_t*)data;
+    reader->size = file_stat.st_size;
+    reader->header = (const DatasetHeader*)data;
+
+    const DatasetHeader* header = reader->header;
+    const char* problem = NULL;
+    if (memcmp(header->magic, DATASET_MAGIC, sizeof(DATASET_MAGIC)) != 0)
+    {
+        problem = "is not a dataset";
+    }
+    else if (header->version != DATASET_VERSION)
+    {
+        problem = "is from an incompatible version";
+    }
+    else if (!(header->flags & DATASET_FLAG_COMPLETE))
+    {
+        problem = "was never finished";
+    }
+    else if (header->count > reader->size / sizeof(DatasetIndexEntry)
+             || !in_file(header->index_offset, header->count * sizeof(DatasetIndexEntry), reader->size))
+    {
+        problem = "is truncated";
+    }
+    else
+    {
+        reader->index = (const DatasetIndexEntry*)(reader->data + header->index_offset);
+        if (!index_in_file(reader))
+        {
+            problem = "has an index pointing outside the file";
+        }
+    }
+
+    if (problem)
+    {
+        fprintf(stderr, "%s %s\n", filename, problem);
+        dataset_close(reader);
+        return -1;
+    }
+
+    return 0;
+}
+
+void dataset_close(DatasetReader* reader)
+{
+    if (reader->data)
+    {
+        munmap((void*)reader->data, reader->size);
+    }
+    memset(reader, 0, sizeof(*reader));
+}
+
+uint64_t dataset_count(const DatasetReader* reader)
+{
+    return reader->header->count;
+}
+
+uint64_t dataset_sample_index(const DatasetReader* reader, uint64_t slot)
+{
+    return reader->index[slot].sample_index;
+}
+
+const uint16_t* dataset_frame(const DatasetReader* reader, uint64_t slot)
+{
+    return (const uint16_t*)(reader->data + reader->index[slot].frame_offset);
+}
+
+const void* dataset_state(const DatasetReader* reader, uint64_t slot)
+{
+    return reader->data + reader->index[slot].state_offset;
+}
@@ -0,0 +1,118 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+// Packed dataset container (.hrzpack)
+//
+// Holds a whole dataset in one file instead of a png, bin and hrz per sample.
+// Everything is little-endian and laid out so the file can be mmapped and
+// used in place:
+//
+//   offset 0             DatasetHeader, padded to DATASET_ALIGNMENT
+//   index_offset         DatasetIndexEntry[count]
+//   frames_offset        count frames, frame_stride bytes apart. Each is
+//                        frame_width * frame_height uint16 pixels, top row
+//                        first, in the same format as the .bin files (the
+//                        sensor's bit depth, 14 for the Lepton).
+//   states_offset        count SimulationState records (the .hrz contents),
+//                        state_stride bytes apart
+//
+// Every block starts on a DATASET_ALIGNMENT boundary. Entry i of the index
+// gives the fuzz run sample index of slot i and the absolute offsets of its
+// frame and state, so readers don't need to know the strides.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DATASET_MAGIC "HRZPACK"
+#define DATASET_VERSION 1
+#define DATASET_ALIGNMENT 4096
+
+// Set once every slot has been written. Files without it were interrupted.
+#define DATASET_FLAG_COMPLETE 1
+
+#pragma pack(push, 1)
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+
+    uint32_t frame_width;
+    uint32_t frame_height;
+    uint32_t bytes_per_pixel;
+    uint32_t state_size;
+
+    uint64_t count;
+
+    uint64_t index_offset;
+    uint64_t frames_offset;
+    uint64_t frame_stride;
+    uint64_t states_offset;
+    uint64_t state_stride;
+} DatasetHeader;
+
+typedef struct
+{
+    uint64_t sample_index;
+    uint64_t frame_offset;
+    uint64_t state_offset;
+} DatasetIndexEntry;
+#pragma pack(pop)
+
+typedef struct
+{
+    int fd;
+    DatasetHeader header;
+
+    // Set by any dataset_write that fails, or by dataset_fail, so
+    // dataset_finish leaves the file incomplete. Writer threads set it
+    // concurrently, so it's only accessed atomically (see dataset.c); it's a
+    // plain int so C and C++ share the struct.
+    int failed;
+} DatasetWriter;
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t size;
+    const DatasetHeader* header;
+    const DatasetIndexEntry* index;
+} DatasetReader;
+
+// Creates a dataset file with room for `count` samples.
+// Returns 0 on success.
+int dataset_create(DatasetWriter* writer, const char* filename, uint32_t frame_width, uint32_t frame_height, uint32_t state_size, uint64_t count);
+
+// Writes one sample into `slot`. Slots can be written in any order and from
+// several threads at once.
+// Returns 0 on success.
+int dataset_write(DatasetWriter* writer, uint64_t slot, uint64_t sample_index, const uint16_t* frame, const void* state);
+
+// Leaves the dataset incomplete when it's finished, for samples the caller
+// never got to write. Safe to call from any thread.
+void dataset_fail(DatasetWriter* writer);
+
+// Marks the dataset complete and closes it. Returns 0 on success, or -1
+// without marking it complete if any dataset_write failed.
+int dataset_finish(DatasetWriter* writer);
+
+// Maps a dataset file. Returns 0 on success.
+int dataset_open(DatasetReader* reader, const char* filename);
+void dataset_close(DatasetReader* reader);
+
+uint64_t dataset_count(const DatasetReader* reader);
+uint64_t dataset_sample_index(const DatasetReader* reader, uint64_t slot);
+
+// Pointers straight into the mapping
+const uint16_t* dataset_frame(const DatasetReader* reader, uint64_t slot);
+const void* dataset_state(const DatasetReader* reader, uint64_t slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // include guard
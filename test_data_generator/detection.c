@@ -0,0 +1,78 @@
+#include "detection.h"
+
+#include "detect.h"
+#include "imdistort.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+_Static_assert(DETECTION_WIDTH == C_DIM && DETECTION_HEIGHT == R_DIM, "detection.h has the wrong frame size");
+_Static_assert(DETECTION_STAGES == DETECT_STAGE_COUNT, "detection.h has the wrong number of stages");
+_Static_assert(sizeof(Vec2D) == 2 * sizeof(float), "edge points have to be float pairs");
+
+const char* detection_stage_name(unsigned int stage)
+{
+    return stage < DETECTION_STAGES ? detect_stage_names[stage] : "?";
+}
+
+void detection_run(const uint16_t* pixels, float altitude_, const int16_t magnetometer[3],
+                   const float magnetometer_transformation_[16], int alg_choice_, int correct_barrel_dist_,
+                   DetectionResult* result)
+{
+    memcpy(TestImg, pixels, sizeof(TestImg));
+    memcpy(magnetometer_reading, magnetometer, sizeof(magnetometer_reading));
+    memcpy(magnetometer_transformation, magnetometer_transformation_, sizeof(magnetometer_transformation));
+    altitude = altitude_;
+    alg_choice = alg_choice_;
+    correct_barrel_dist = correct_barrel_dist_;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    detect_horizon();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // detect_horizon only corrects the points it goes on to fit
+    result->points_corrected = correct_barrel_dist_ && num_points > min_required_points;
+    result->reject = reject;
+    memcpy(result->nadir, nadir, sizeof(result->nadir));
+    memcpy(result->circle, circ_params, sizeof(result->circle));
+    result->point_count = num_points;
+    result->points = (const float*)edge_points;
+
+    result->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    uint64_t total_cycles = 0;
+    for (unsigned int stage = 0; stage < DETECTION_STAGES; ++stage)
+    {
+        result->stage_cycles[stage] = stage_cycles[stage];
+        total_cycles += stage_cycles[stage];
+    }
+    for (unsigned int stage = 0; stage < DETECTION_STAGES; ++stage)
+    {
+        result->stage_seconds[stage] = total_cycles ? result->seconds * stage_cycles[stage] / total_cycles : 0.0;
+    }
+}
+
+void detection_to_frame(const DetectionResult* result, float x, float y, float* frame_x, float* frame_y)
+{
+    if (result->points_corrected)
+    {
+        // remove_barrel_distort_FO scales a point at distance d from the
+        // centre by 1 + k d^2, so solve r = d (1 + k d^2) for d
+        float corner_sq = (C_DIM * 0.5f) * (C_DIM * 0.5f) + (R_DIM * 0.5f) * (R_DIM * 0.5f);
+        float k = LEPTON_35_PD / ((1.0f - LEPTON_35_PD) * corner_sq);
+        float r = sqrtf(x * x + y * y);
+        float d = r;
+        for (int i = 0; i < 4; ++i)
+        {
+            d -= (d + k * d * d * d - r) / (1.0f + 3.0f * k * d * d);
+        }
+        if (r > 0.0f)
+        {
+            x *= d / r;
+            y *= d / r;
+        }
+    }
+    *frame_x = x + C_DIM * 0.5f;
+    *frame_y = R_DIM * 0.5f - y;
+}
@@ -0,0 +1,61 @@
+#ifndef DETECTION_H
+#define DETECTION_H
+
+// A host build of the horizon detector (zynq_sw/src/detect.h)
+//
+// The detector works on globals sized for the Lepton, so there's one of it
+// per process and it only takes 160x120 frames. Its headers define their own
+// Quaternion, so they're kept out of the generator behind this.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DETECTION_WIDTH 160
+#define DETECTION_HEIGHT 120
+#define DETECTION_STAGES 8
+
+typedef struct
+{
+    // detect.h's reject: 0 if nadir is valid, 1 for too few edge points,
+    // 2 for a circle that's too small
+    int reject;
+    float nadir[3];
+
+    // Fitted circle (centre x, y and radius) and edge points (x, y pairs), in
+    // pixels from the centre of the frame with y up. The points are the
+    // detector's own array, and change on the next run. They're corrected for
+    // barrel distortion if the detector was asked to and found enough of them
+    // to fit a circle, and the circle is fitted to the corrected points.
+    float circle[3];
+    uint32_t point_count;
+    const float* points;
+    int points_corrected;
+
+    // get_ccount counts of each stage, and the run's wall-clock time split
+    // between the stages by them
+    uint32_t stage_cycles[DETECTION_STAGES];
+    double stage_seconds[DETECTION_STAGES];
+    double seconds;
+} DetectionResult;
+
+const char* detection_stage_name(unsigned int stage);
+
+// Runs the detector on a frame of 14-bit pixels, top row first, with the
+// readings that went with it. alg_choice and correct_barrel_dist are the
+// detector's parameters of the same names.
+void detection_run(const uint16_t* pixels, float altitude, const int16_t magnetometer[3],
+                   const float magnetometer_transformation[16], int alg_choice, int correct_barrel_dist,
+                   DetectionResult* result);
+
+// Where a point of the result is in the frame, in pixels from the top left
+// corner, putting back the distortion the detector took out
+void detection_to_frame(const DetectionResult* result, float x, float y, float* frame_x, float* frame_y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // include guard
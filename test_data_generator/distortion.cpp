@@ -0,0 +1,88 @@
+#include "distortion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+// Multiplier on a pixel's offset from the centre, for a squared radius
+// normalized to the corner. Higher order terms go here.
+static double distortion_scale(const DistortionTable& table, double r_sq)
+{
+    return 1.0 + table.K1 * r_sq + table.K2 * r_sq * r_sq;
+}
+
+static void build_table(DistortionTable* table)
+{
+    uint32_t width = table->width;
+    uint32_t height = table->height;
+    size_t pixels = (size_t)width * height;
+    table->rays.resize(3 * pixels);
+
+    float* ray_x = table->rays.data();
+    float* ray_y = ray_x + pixels;
+    float* ray_z = ray_y + pixels;
+
+    double inv_screen_radius_sq = 1.0 / (0.25 * ((double)width * width + (double)height * height));
+    // Width of the image plane at z = -1
+    double image_plane_width = 2.0 * tan(0.5 * table->horizontal_fov * M_PI / 180.0);
+    double pixel_scale = image_plane_width / width;
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            double fx = x + 0.5 - 0.5 * width;
+            double fy = y + 0.5 - 0.5 * height;
+            double scale = distortion_scale(*table, (fx*fx + fy*fy) * inv_screen_radius_sq) * pixel_scale;
+
+            double dx = fx * scale;
+            double dy = fy * scale;
+            double inv_length = 1.0 / sqrt(dx*dx + dy*dy + 1.0);
+
+            size_t i = (size_t)y * width + x;
+            ray_x[i] = dx * inv_length;
+            ray_y[i] = dy * inv_length;
+            ray_z[i] = -inv_length;
+        }
+    }
+}
+
+std::shared_ptr<const DistortionTable> distortion_table(float K1, float K2, float horizontal_fov, uint32_t width, uint32_t height)
+{
+    static std::mutex tables_mutex;
+    // Most recently used first
+    static std::vector<std::shared_ptr<const DistortionTable>> tables;
+
+    std::lock_guard<std::mutex> lock(tables_mutex);
+
+    // Compared bit for bit, so a table is never reused for a lens it wasn't
+    // built for
+    for (size_t i = 0; i < tables.size(); ++i)
+    {
+        const DistortionTable& table = *tables[i];
+        if (table.width == width && table.height == height
+            && memcmp(&table.K1, &K1, sizeof(K1)) == 0 && memcmp(&table.K2, &K2, sizeof(K2)) == 0
+            && memcmp(&table.horizontal_fov, &horizontal_fov, sizeof(horizontal_fov)) == 0)
+        {
+            std::rotate(tables.begin(), tables.begin() + i, tables.begin() + i + 1);
+            return tables.front();
+        }
+    }
+
+    std::shared_ptr<DistortionTable> table = std::make_shared<DistortionTable>();
+    table->K1 = K1;
+    table->K2 = K2;
+    table->horizontal_fov = horizontal_fov;
+    table->width = width;
+    table->height = height;
+    build_table(table.get());
+
+    if (tables.size() == DISTORTION_CACHE_SIZE)
+    {
+        tables.pop_back();
+    }
+    tables.insert(tables.begin(), table);
+    return table;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// Lens distortion, precomputed per pixel
+//
+// The camera model is radial (Brown-Conrady) distortion of a pinhole camera
+// with the sensor's horizontal field of view. A pixel at offset (x, y) from
+// the image centre looks along the undistorted ray for
+// (x, y) * (1 + K1 r^2 + K2 r^4), where r is its distance from the centre as
+// a fraction of the centre to corner distance. That only depends on the
+// coefficients, field of view and resolution, so it's worked out once per
+// table, in double precision, and both renderers shade a pixel with one dot
+// product between its ray and the nadir vector. More terms only make building
+// a table slower.
+struct DistortionTable
+{
+    float K1;
+    float K2;
+    float horizontal_fov;   // degrees
+    uint32_t width;
+    uint32_t height;
+
+    // Unit ray through the centre of each pixel, bottom row first like the
+    // rendered frames, in camera coordinates (looking down -z). x, y and z
+    // are in separate planes of width * height floats each.
+    std::vector<float> rays;
+
+    const float* ray_x() const { return rays.data(); }
+    const float* ray_y() const { return rays.data() + width * height; }
+    const float* ray_z() const { return rays.data() + 2 * width * height; }
+};
+
+// Number of tables kept for reuse. Lenses and sizes change rarely within a
+// run, but the GUI's sliders and window and libhrzgen callers can ask for any
+// number of them, so only the most recently used are kept.
+#define DISTORTION_CACHE_SIZE 8
+
+// The table for this lens and resolution, building it if it isn't one of the
+// DISTORTION_CACHE_SIZE most recently used. Tables are shared by every
+// thread, and one that's dropped from the cache lives on until the last
+// caller holding it lets go.
+std::shared_ptr<const DistortionTable> distortion_table(float K1, float K2, float horizontal_fov, uint32_t width, uint32_t height);
@@ -0,0 +1,32 @@
+# Turns each text file on the command line into a C string constant named
+# after the file, so screen_shader.frag becomes screen_shader_frag.
+#
+# Usage: awk -f embed_text.awk <files> > header.h
+
+BEGIN {
+    print "// Generated by embed_text.awk from the Makefile, don't edit"
+    print "#pragma once"
+}
+
+FNR == 1 {
+    if (NR != 1)
+    {
+        print ";"
+    }
+    name = FILENAME
+    sub(/.*\//, "", name)
+    gsub(/[^A-Za-z0-9_]/, "_", name)
+    print ""
+    print "static const char " name "[] ="
+}
+
+{
+    line = $0
+    gsub(/\\/, "\\\\", line)
+    gsub(/"/, "\\\"", line)
+    print "    \"" line "\\n\""
+}
+
+END {
+    print ";"
+}
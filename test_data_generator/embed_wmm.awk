@@ -0,0 +1,30 @@
+# Turns a WMM.COF coefficient file into a C table for wmm_embedded.c.
+# The numbers are copied as text, so the compiler parses them exactly the way
+# MAG_readMagneticModel's sscanf would.
+#
+# Usage: awk -f embed_wmm.awk WMM_2020/WMM.COF > wmm_coefficients.h
+
+NR == 1 {
+    print "// Generated by embed_wmm.awk from the Makefile, don't edit"
+    print "#pragma once"
+    print ""
+    print "#define WMM_EMBEDDED_EPOCH " $1
+    print "#define WMM_EMBEDDED_NAME \"" $2 "\""
+    print ""
+    print "// n, m, g, h, secular g, secular h"
+    print "static const WmmCoefficient wmm_embedded_coefficients[] ="
+    print "{"
+    next
+}
+
+/^9999/ {
+    exit
+}
+
+NF == 6 {
+    print "    { " $1 ", " $2 ", " $3 ", " $4 ", " $5 ", " $6 " },"
+}
+
+END {
+    print "};"
+}
@@ -0,0 +1,149 @@
+#include "export.h"
+#include "profiler.h"
+#include "pack14.h"
+#include "ircodec.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+unsigned char* encode_image(const CapturedFrame& frame, int* length)
+{
+    ProfileTimer timer(STAGE_ENCODE_PNG);
+
+    // An 8-bit framebuffer reads back as v * 257, so this gives back exactly
+    // the bytes a GL_UNSIGNED_BYTE read would have.
+    std::vector<uint8_t> pixels(frame.pixels.size());
+    for (size_t i = 0; i < pixels.size(); ++i)
+    {
+        pixels[i] = frame.pixels[i] >> 8;
+    }
+
+    return stbi_write_png_to_mem(pixels.data(), frame.width, frame.width, frame.height, 1, length);
+}
+
+// Writes `size` bytes to a new file. Returns false, having printed why, if
+// it can't be opened or written.
+static bool write_file(const char* filename, const void* data, size_t size)
+{
+    FILE* fd = fopen(filename, "wb");
+    if (!fd)
+    {
+        perror(filename);
+        return false;
+    }
+    bool written = fwrite(data, 1, size, fd) == size;
+    if (fclose(fd) != 0 || !written)
+    {
+        perror(filename);
+        return false;
+    }
+    return true;
+}
+
+bool export_image(const char* filename, const CapturedFrame& frame)
+{
+    int length = 0;
+    unsigned char* png = encode_image(frame, &length);
+    if (!png)
+    {
+        fprintf(stderr, "Couldn't encode %s\n", filename);
+        return false;
+    }
+
+    ProfileTimer timer(STAGE_WRITE);
+    bool written = write_file(filename, png, length);
+    free(png);
+    return written;
+}
+
+void frame_to_lepton(const CapturedFrame& frame, uint16_t* pixels)
+{
+    ProfileTimer timer(STAGE_CONVERT);
+
+    // The Lepton 3.5 data format actually only uses 14 bits per pixel
+    // with the upper two bits set to zero, so we'll discard the two LSb.
+    // Other sensors keep their own bit depth the same way.
+    unsigned int shift = 16 - frame.state.bit_depth;
+    for (size_t i = 0; i < frame.pixels.size(); i++)
+    {
+        pixels[i] = frame.pixels[i] >> shift;
+    }
+}
+
+bool export_binary(const char* filename, const CapturedFrame& frame)
+{
+    std::vector<uint16_t> pixels(frame.pixels.size());
+    frame_to_lepton(frame, pixels.data());
+
+    ProfileTimer timer(STAGE_WRITE);
+    return write_file(filename, pixels.data(), pixels.size() * sizeof(uint16_t));
+}
+
+bool export_packed(const char* filename, const CapturedFrame& frame)
+{
+    std::vector<uint16_t> pixels(frame.pixels.size());
+    frame_to_lepton(frame, pixels.data());
+
+    std::vector<uint8_t> packed(PACK14_BYTES(pixels.size()));
+    {
+        ProfileTimer timer(STAGE_CONVERT);
+        pack14(pixels.data(), packed.data(), pixels.size());
+    }
+
+    ProfileTimer timer(STAGE_WRITE);
+    return write_file(filename, packed.data(), packed.size());
+}
+
+bool export_compressed(const char* filename, const CapturedFrame& frame)
+{
+    std::vector<uint16_t> pixels(frame.pixels.size());
+    frame_to_lepton(frame, pixels.data());
+
+    std::vector<uint8_t> compressed(IRC_MAX_BYTES(pixels.size()));
+    size_t size = 0;
+    {
+        ProfileTimer timer(STAGE_CONVERT);
+        size = irc_encode(pixels.data(), frame.width, frame.height, frame.state.bit_depth, compressed.data(), compressed.size());
+    }
+
+    // No file at all rather than an empty one that won't decode
+    if (size == 0)
+    {
+        fprintf(stderr, "Couldn't compress %s\n", filename);
+        return false;
+    }
+
+    ProfileTimer timer(STAGE_WRITE);
+    return write_file(filename, compressed.data(), size);
+}
+
+bool export_all(const std::string& filename, const CapturedFrame& frame, RawFormat raw_format)
+{
+    std::string png_filename = filename + std::string(".png");
+    std::string hrz_filename = filename + std::string(".hrz");
+
+    bool written = export_image(png_filename.c_str(), frame);
+    if (raw_format == RAW_IRC)
+    {
+        written &= export_compressed((filename + std::string(".irc")).c_str(), frame);
+    }
+    else if (raw_format == RAW_PACKED14 && frame.state.bit_depth <= 14)
+    {
+        written &= export_packed((filename + std::string(".b14")).c_str(), frame);
+    }
+    else
+    {
+        written &= export_binary((filename + std::string(".bin")).c_str(), frame);
+    }
+
+    ProfileTimer timer(STAGE_WRITE);
+    if (!frame.state.save_state(hrz_filename.c_str()))
+    {
+        fprintf(stderr, "Couldn't write %s\n", hrz_filename.c_str());
+        written = false;
+    }
+    return written;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "capture.h"
+
+#include <string>
+
+// Compresses the frame into an 8-bit png in memory. The result is freed
+// with free().
+unsigned char* encode_image(const CapturedFrame& frame, int* length);
+
+// The export_ functions return false, having printed why, if the frame
+// couldn't be encoded or written.
+
+// Writes the frame as an 8-bit png, for looking at
+bool export_image(const char* filename, const CapturedFrame& frame);
+
+// Converts the frame to the Lepton 3.5 format the detector reads: pixels of
+// the sensor's bit depth (14 for the Lepton) in uint16s, top row first.
+// `pixels` holds frame.width * frame.height values.
+void frame_to_lepton(const CapturedFrame& frame, uint16_t* pixels);
+
+// How export_all writes the frame's pixels
+enum RawFormat
+{
+    // 4 pixels in 7 bytes, in a .b14 file (see pack14.h). Frames from
+    // sensors with more than 14 bits are written as RAW_UINT16 instead.
+    RAW_PACKED14,
+
+    // A uint16 per pixel, in a .bin file
+    RAW_UINT16,
+
+    // Losslessly compressed, in a .irc file (see ircodec.h)
+    RAW_IRC
+};
+
+// Writes the frame in the Lepton 3.5 format
+bool export_binary(const char* filename, const CapturedFrame& frame);
+
+// Writes the frame's Lepton 3.5 pixels packed 14 bits each
+bool export_packed(const char* filename, const CapturedFrame& frame);
+
+// Writes the frame's Lepton 3.5 pixels losslessly compressed
+bool export_compressed(const char* filename, const CapturedFrame& frame);
+
+// Writes <filename>.png, <filename>.b14, .bin or .irc, and <filename>.hrz
+bool export_all(const std::string& filename, const CapturedFrame& frame, RawFormat raw_format);
@@ -0,0 +1,322 @@
+#include "frame_ring.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// The shared counters are plain uint64_ts in the header so C, C++ and
+// anything else that maps the file see the same layout. They're only ever
+// accessed through these.
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ADD_RELAXED(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// Spins for a little while, then sleeps in short steps, so a waiting side
+// reacts quickly without burning a core when the other side is slow
+static void wait_a_bit(unsigned int* attempts)
+{
+    if (*attempts < 64)
+    {
+        ++*attempts;
+        sched_yield();
+    }
+    else
+    {
+        struct timespec pause = { 0, 20000 };
+        nanosleep(&pause, NULL);
+    }
+}
+
+static FrameRingSlot* ring_slot(const FrameRing* ring, uint64_t n)
+{
+    const FrameRingHeader* header = ring->header;
+    return (FrameRingSlot*)(ring->data + header->slots_offset + (n % header->slot_count) * header->slot_stride);
+}
+
+int frame_ring_create(FrameRing* ring, const char* name, uint32_t frame_width, uint32_t frame_height, uint32_t state_size,
+                      uint64_t slot_count, int drop_when_full,
+                      uint64_t sample_first, uint64_t sample_stride, uint64_t sample_count)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->name = name;
+
+    uint64_t frame_offset = sizeof(FrameRingSlot);
+    uint64_t state_offset = align_up(frame_offset + (uint64_t)frame_width * frame_height * sizeof(uint16_t), 64);
+    uint64_t slot_stride = align_up(state_offset + state_size, 64);
+    uint64_t slots_offset = FRAME_RING_ALIGNMENT;
+    size_t size = align_up(slots_offset + slot_count * slot_stride, FRAME_RING_ALIGNMENT);
+
+    // Anything left over from an earlier run would confuse its consumers
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        perror(name);
+        return -1;
+    }
+    if (ftruncate(fd, size) != 0)
+    {
+        perror(name);
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(name);
+        shm_unlink(name);
+        return -1;
+    }
+
+    ring->data = (uint8_t*)data;
+    ring->size = size;
+    ring->header = (FrameRingHeader*)data;
+
+    // ftruncate zeroed everything, including all the counters
+    FrameRingHeader* header = ring->header;
+    header->version = FRAME_RING_VERSION;
+    header->drop_when_full = drop_when_full ? 1 : 0;
+    header->frame_width = frame_width;
+    header->frame_height = frame_height;
+    header->bytes_per_pixel = sizeof(uint16_t);
+    header->state_size = state_size;
+    header->slot_count = slot_count;
+    header->slot_stride = slot_stride;
+    header->slots_offset = slots_offset;
+    header->frame_offset = frame_offset;
+    header->state_offset = state_offset;
+    header->sample_first = sample_first;
+    header->sample_stride = sample_stride;
+    header->sample_count = sample_count;
+
+    // The magic goes in last, so consumers that open the ring early don't
+    // see a half written header
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, FRAME_RING_MAGIC, sizeof(FRAME_RING_MAGIC));
+
+    return 0;
+}
+
+int frame_ring_publish(FrameRing* ring, uint64_t sample_index, const uint16_t* frame, const void* state, int timeout_ms)
+{
+    FrameRingHeader* header = ring->header;
+
+    // Only this side writes write_sequence
+    uint64_t n = header->write_sequence;
+
+    if (n - LOAD_ACQUIRE(&header->read_sequence) >= header->slot_count)
+    {
+        if (header->drop_when_full)
+        {
+            // Frame n - slot_count is about to be overwritten unread
+            ADD_RELAXED(&header->dropped, 1);
+        }
+        else
+        {
+            uint64_t wait_start = now_ns();
+            uint64_t deadline = timeout_ms >= 0 ? wait_start + (uint64_t)timeout_ms * 1000000ull : 0;
+            unsigned int attempts = 0;
+            int timed_out = 0;
+            while (n - LOAD_ACQUIRE(&header->read_sequence) >= header->slot_count)
+            {
+                if (timeout_ms >= 0 && now_ns() >= deadline)
+                {
+                    timed_out = 1;
+                    break;
+                }
+                wait_a_bit(&attempts);
+            }
+            ADD_RELAXED(&header->full_waits, 1);
+            ADD_RELAXED(&header->full_wait_ns, now_ns() - wait_start);
+            if (timed_out)
+            {
+                return -1;
+            }
+        }
+    }
+
+    FrameRingSlot* slot = ring_slot(ring, n);
+
+    // Odd while the slot is being written
+    __atomic_store_n(&slot->sequence, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->sample_index = sample_index;
+    memcpy((uint8_t*)slot + header->frame_offset, frame, (size_t)header->frame_width * header->frame_height * sizeof(uint16_t));
+    memcpy((uint8_t*)slot + header->state_offset, state, header->state_size);
+
+    STORE_RELEASE(&slot->sequence, 2 * (n + 1));
+    STORE_RELEASE(&header->write_sequence, n + 1);
+    return 0;
+}
+
+void frame_ring_finish(FrameRing* ring)
+{
+    STORE_RELEASE(&ring->header->finished, 1);
+    frame_ring_close(ring);
+}
+
+int frame_ring_open(FrameRing* ring, const char* name)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->name = name;
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        perror(name);
+        return -1;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(FrameRingHeader))
+    {
+        fprintf(stderr, "%s is too small to be a frame ring\n", name);
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(name);
+        return -1;
+    }
+
+    ring->data = (uint8_t*)data;
+    ring->size = file_stat.st_size;
+    ring->header = (FrameRingHeader*)data;
+
+    const FrameRingHeader* header = ring->header;
+    const char* problem = NULL;
+    if (memcmp(header->magic, FRAME_RING_MAGIC, sizeof(FRAME_RING_MAGIC)) != 0)
+    {
+        problem = "is not a frame ring (or isn't set up yet)";
+    }
+    else if (header->version != FRAME_RING_VERSION)
+    {
+        problem = "is from an incompatible version";
+    }
+    else if (header->slot_count == 0 || header->slots_offset + header->slot_count * header->slot_stride > ring->size)
+    {
+        problem = "is truncated";
+    }
+
+    if (problem)
+    {
+        fprintf(stderr, "%s %s\n", name, problem);
+        frame_ring_close(ring);
+        return -1;
+    }
+
+    // Start from the oldest frame still in the ring
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t written = LOAD_ACQUIRE(&ring->header->write_sequence);
+    uint64_t released = LOAD_ACQUIRE(&ring->header->read_sequence);
+    ring->next = written - released > header->slot_count ? written - header->slot_count : released;
+
+    return 0;
+}
+
+int frame_ring_acquire(FrameRing* ring, FrameRingSample* sample, int timeout_ms)
+{
+    FrameRingHeader* header = ring->header;
+    uint64_t deadline = timeout_ms >= 0 ? now_ns() + (uint64_t)timeout_ms * 1000000ull : 0;
+    unsigned int attempts = 0;
+
+    while (1)
+    {
+        // Read before write_sequence, so a frame published just before the
+        // producer finished is never missed
+        int finished = LOAD_ACQUIRE(&header->finished) != 0;
+        uint64_t written = LOAD_ACQUIRE(&header->write_sequence);
+
+        if (ring->next < written)
+        {
+            if (written - ring->next > header->slot_count)
+            {
+                // Fell more than a whole ring behind, those are gone
+                ring->dropped += written - header->slot_count - ring->next;
+                ring->next = written - header->slot_count;
+            }
+
+            FrameRingSlot* slot = ring_slot(ring, ring->next);
+            if (LOAD_ACQUIRE(&slot->sequence) != 2 * (ring->next + 1))
+            {
+                // Already being overwritten
+                ++ring->dropped;
+                ++ring->next;
+                continue;
+            }
+
+            sample->sample_index = slot->sample_index;
+            sample->frame = (const uint16_t*)((const uint8_t*)slot + header->frame_offset);
+            sample->state = (const uint8_t*)slot + header->state_offset;
+            return 1;
+        }
+
+        if (finished)
+        {
+            return 0;
+        }
+        if (timeout_ms >= 0 && now_ns() >= deadline)
+        {
+            return -1;
+        }
+        wait_a_bit(&attempts);
+    }
+}
+
+int frame_ring_release(FrameRing* ring)
+{
+    FrameRingSlot* slot = ring_slot(ring, ring->next);
+
+    // Everything read from the slot has to happen before this check
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    int intact = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == 2 * (ring->next + 1);
+
+    ++ring->next;
+    STORE_RELEASE(&ring->header->read_sequence, ring->next);
+
+    if (!intact)
+    {
+        ++ring->dropped;
+        return -1;
+    }
+    return 0;
+}
+
+void frame_ring_close(FrameRing* ring)
+{
+    if (ring->data)
+    {
+        munmap(ring->data, ring->size);
+    }
+    memset(ring, 0, sizeof(*ring));
+}
+
+int frame_ring_unlink(const char* name)
+{
+    return shm_unlink(name);
+}
@@ -0,0 +1,150 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+// Shared memory frame ring (--stream)
+//
+// The generator publishes each frame and its SimulationState into a ring of
+// slots in a POSIX shared memory object (/dev/shm/<name> on Linux), and
+// consumers in other processes read them in place, without any files. There
+// is one producer. The ring itself is lock-free: the producer and consumers
+// only communicate through the sequence counters below.
+//
+//   offset 0             FrameRingHeader, padded to FRAME_RING_ALIGNMENT
+//   slots_offset         slot_count slots, slot_stride bytes apart. Each is a
+//                        FrameRingSlot, then frame_width * frame_height uint16
+//                        pixels (top row first, like the .bin files)
+//                        at frame_offset, then the state at state_offset.
+//
+// Frame number n (counting from 0 in the order they're published) goes in
+// slot n % slot_count. A slot's sequence is odd while the producer is
+// writing it and 2 * (n + 1) once frame n is in it, so a reader can tell
+// whether the frame it's looking at was replaced underneath it.
+//
+// In the default blocking mode the producer waits whenever the ring is full,
+// until the consumer releases a frame (only one consumer should read a
+// blocking ring). With drop_when_full it never waits and overwrites the
+// oldest frame instead, counting the frames the consumer never got to.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_RING_MAGIC "HRZRING"
+#define FRAME_RING_VERSION 1
+#define FRAME_RING_ALIGNMENT 4096
+
+#pragma pack(push, 1)
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t drop_when_full;
+
+    uint32_t frame_width;
+    uint32_t frame_height;
+    uint32_t bytes_per_pixel;
+    uint32_t state_size;
+
+    uint64_t slot_count;
+    uint64_t slot_stride;
+    uint64_t slots_offset;
+    uint64_t frame_offset;      // from the start of a slot
+    uint64_t state_offset;
+
+    // The samples that will be streamed have indices sample_first +
+    // n * sample_stride for n below sample_count, in whatever order they're
+    // rendered in
+    uint64_t sample_first;
+    uint64_t sample_stride;
+    uint64_t sample_count;
+
+    // Everything below changes while streaming, and is read and written with
+    // atomics. Producer and consumer fields are on separate cache lines.
+    uint8_t padding0[32];
+
+    // Written by the producer
+    uint64_t write_sequence;    // frames published
+    uint64_t finished;          // nonzero once the producer is done
+    uint64_t dropped;           // frames overwritten before the consumer released them
+    uint64_t full_waits;        // times the producer found the ring full and waited
+    uint64_t full_wait_ns;      // total time spent waiting
+    uint8_t padding1[24];
+
+    // Written by the consumer
+    uint64_t read_sequence;     // frames released
+    uint8_t padding2[56];
+} FrameRingHeader;
+
+typedef struct
+{
+    uint64_t sequence;
+    uint64_t sample_index;
+    uint8_t padding[48];
+} FrameRingSlot;
+#pragma pack(pop)
+
+typedef struct
+{
+    const char* name;
+    uint8_t* data;
+    size_t size;
+    FrameRingHeader* header;
+
+    // Consumer only: the next frame number to read, and frames this consumer
+    // skipped because they were overwritten first
+    uint64_t next;
+    uint64_t dropped;
+} FrameRing;
+
+// A frame handed out by frame_ring_acquire. The pointers are into the shared
+// memory and stay valid until frame_ring_release.
+typedef struct
+{
+    uint64_t sample_index;
+    const uint16_t* frame;
+    const void* state;
+} FrameRingSample;
+
+// Creates the shared memory object `name` (which must start with '/'),
+// replacing any old one with the same name. Returns 0 on success.
+int frame_ring_create(FrameRing* ring, const char* name, uint32_t frame_width, uint32_t frame_height, uint32_t state_size,
+                      uint64_t slot_count, int drop_when_full,
+                      uint64_t sample_first, uint64_t sample_stride, uint64_t sample_count);
+
+// Copies a frame and its state into the next slot and makes it visible to
+// consumers. Unless the ring drops frames, waits while it's full, for up to
+// timeout_ms without the consumer releasing one (or forever if negative).
+// Returns 0, or -1 without publishing if it timed out.
+int frame_ring_publish(FrameRing* ring, uint64_t sample_index, const uint16_t* frame, const void* state, int timeout_ms);
+
+// Tells consumers there's nothing more coming and unmaps the ring. The
+// shared memory object stays until frame_ring_unlink.
+void frame_ring_finish(FrameRing* ring);
+
+// Maps an existing ring. Returns 0 on success.
+int frame_ring_open(FrameRing* ring, const char* name);
+
+// Waits up to timeout_ms (or forever if negative) for the next frame.
+// Returns 1 with `sample` filled in, 0 once the producer has finished and
+// every frame has been read, or -1 on timeout.
+int frame_ring_acquire(FrameRing* ring, FrameRingSample* sample, int timeout_ms);
+
+// Done with the frame from frame_ring_acquire, its slot can be reused.
+// Returns 0, or -1 if the producer overwrote the frame while it was being
+// read (only possible with drop_when_full), in which case it's counted as
+// dropped.
+int frame_ring_release(FrameRing* ring);
+
+void frame_ring_close(FrameRing* ring);
+
+// Removes the shared memory object. Mappings that are still open keep working.
+int frame_ring_unlink(const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // include guard
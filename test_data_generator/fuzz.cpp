@@ -0,0 +1,308 @@
+#include "fuzz.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+
+// orientation and magnetometer_orientation take 3 each, the ranges 1 each
+static const unsigned int MAX_DIMENSIONS = 11;
+
+static const unsigned int HALTON_BASES[MAX_DIMENSIONS] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31};
+
+// Primitive polynomials and initial direction numbers for Sobol dimensions
+// 2 and up, from Joe and Kuo's new-joe-kuo-6.21201. Dimension 1 is the van
+// der Corput sequence.
+struct SobolPolynomial
+{
+    unsigned int degree;
+    unsigned int coefficients;
+    unsigned int m[5];
+};
+
+static const SobolPolynomial SOBOL_POLYNOMIALS[MAX_DIMENSIONS - 1] = {
+    {1, 0, {1}},
+    {2, 1, {1, 3}},
+    {3, 1, {1, 3, 1}},
+    {3, 2, {1, 1, 1}},
+    {4, 1, {1, 1, 3, 3}},
+    {4, 4, {1, 3, 5, 13}},
+    {5, 2, {1, 1, 5, 5, 17}},
+    {5, 4, {1, 1, 5, 5, 5}},
+    {5, 7, {1, 1, 7, 11, 19}},
+    {5, 11, {1, 1, 5, 1, 1}},
+};
+
+struct SobolDirections
+{
+    uint32_t v[MAX_DIMENSIONS][32];
+
+    SobolDirections()
+    {
+        for (unsigned int bit = 0; bit < 32; ++bit)
+        {
+            v[0][bit] = 1u << (31 - bit);
+        }
+        for (unsigned int d = 1; d < MAX_DIMENSIONS; ++d)
+        {
+            const SobolPolynomial& polynomial = SOBOL_POLYNOMIALS[d - 1];
+            unsigned int s = polynomial.degree;
+            for (unsigned int bit = 0; bit < 32; ++bit)
+            {
+                if (bit < s)
+                {
+                    v[d][bit] = polynomial.m[bit] << (31 - bit);
+                    continue;
+                }
+                uint32_t value = v[d][bit - s] ^ (v[d][bit - s] >> s);
+                for (unsigned int k = 1; k < s; ++k)
+                {
+                    if ((polynomial.coefficients >> (s - 1 - k)) & 1)
+                    {
+                        value ^= v[d][bit - k];
+                    }
+                }
+                v[d][bit] = value;
+            }
+        }
+    }
+};
+
+// Mixes a few values into 32 well spread bits, for scrambling that has to be
+// worked out again for every sample
+static uint32_t hash(uint32_t a, uint32_t b, uint32_t c = 0)
+{
+    uint32_t h = a * 0x9e3779b9u ^ (b + 0x7f4a7c15u) * 0x85ebca6bu ^ (c + 0x165667b1u) * 0xc2b2ae35u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+static float to_unit(uint32_t bits)
+{
+    // 24 bits, which is all a float below 1 can hold
+    return (float)(bits >> 8) / (float)(1 << 24);
+}
+
+static float random_float(std::mt19937& random_engine)
+{
+    return to_unit(random_engine());
+}
+
+// Point `index` of the Sobol sequence, with the digits of each dimension
+// flipped by a random shift. The shift keeps every 2^k aligned run of points
+// stratified the way the plain sequence is.
+static float sobol(unsigned int index, unsigned int dimension, uint32_t seed)
+{
+    static const SobolDirections directions;
+
+    uint32_t bits = hash(seed, dimension);
+    for (unsigned int bit = 0; index; index >>= 1, ++bit)
+    {
+        if (index & 1)
+        {
+            bits ^= directions.v[dimension][bit];
+        }
+    }
+    return to_unit(bits);
+}
+
+// Radical inverse of `index` in the dimension's base, with the digits put
+// through a random permutation. Unscrambled, the higher bases line up with
+// each other for the first few thousand points.
+static float halton(unsigned int index, unsigned int dimension, uint32_t seed)
+{
+    unsigned int base = HALTON_BASES[dimension];
+
+    unsigned int permutation[32];
+    for (unsigned int digit = 0; digit < base; ++digit)
+    {
+        permutation[digit] = digit;
+    }
+    for (unsigned int digit = base - 1; digit > 0; --digit)
+    {
+        std::swap(permutation[digit], permutation[hash(seed, dimension, digit) % (digit + 1)]);
+    }
+
+    // Enough digits for a float, including the scrambled zeros past the last
+    // digit of the index
+    double value = 0.0;
+    double scale = 1.0 / base;
+    for (; scale > 1e-8; scale /= base)
+    {
+        value += permutation[index % base] * scale;
+        index /= base;
+    }
+    return std::min((float)value, 0x1.fffffep-1f);
+}
+
+// Position of `index` in a random permutation of 0 to count - 1 picked by
+// `seed`, without storing the permutation (Kensler, "Correlated
+// Multi-Jittered Sampling", 2013)
+static unsigned int permute(unsigned int index, unsigned int count, uint32_t seed)
+{
+    uint32_t mask = count - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+
+    uint32_t i = index;
+    do
+    {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & mask) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & mask) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & mask) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & mask) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & mask) >> 2;
+        i *= 0xc860a3df;
+        i &= mask;
+        i ^= i >> 5;
+    } while (i >= count);
+    return (i + seed) % count;
+}
+
+// The coordinates of one sample, handed out one dimension at a time in the
+// order the parameters are randomized
+struct SamplePoint
+{
+    const FuzzOptions* fuzz;
+    unsigned int index;
+    std::mt19937* random_engine;
+    unsigned int dimension = 0;
+
+    float next()
+    {
+        unsigned int d = dimension++;
+        switch (fuzz->sampler)
+        {
+            case SAMPLER_SOBOL:
+                return sobol(index, d, fuzz->seed);
+            case SAMPLER_HALTON:
+                return halton(index, d, fuzz->seed);
+            case SAMPLER_STRATIFIED:
+            {
+                // Each block of `count` samples is its own hypercube, so
+                // samples past the end of the run still get strata
+                unsigned int count = std::max(fuzz->count, 1u);
+                unsigned int stratum = permute(index % count, count, hash(fuzz->seed, d, index / count));
+                return (stratum + random_float(*random_engine)) / count;
+            }
+            case SAMPLER_RANDOM:
+                break;
+        }
+        return random_float(*random_engine);
+    }
+};
+
+// A rotation uniformly distributed over all rotations, from three uniform
+// coordinates (Shoemake, "Uniform random rotations", Graphics Gems III)
+static Quaternion uniform_rotation(float u1, float u2, float u3)
+{
+    float r1 = sqrtf(1.0f - u1);
+    float r2 = sqrtf(u1);
+    float theta1 = 2.0f * M_PI * u2;
+    float theta2 = 2.0f * M_PI * u3;
+
+    Quaternion q;
+    q.w = r2 * cosf(theta2);
+    q.x = r1 * sinf(theta1);
+    q.y = r1 * cosf(theta1);
+    q.z = r2 * sinf(theta2);
+    return q;
+}
+
+void randomize_state(SimulationState* state, const FuzzOptions* fuzz, unsigned int sample_index)
+{
+    std::seed_seq seed{fuzz->seed, sample_index};
+    std::mt19937 random_engine(seed);
+    SamplePoint point{fuzz, sample_index, &random_engine};
+
+    if (fuzz->orientation)
+    {
+        if (fuzz->sampler == SAMPLER_RANDOM)
+        {
+            state->camera.w = 2.0f * (random_float(random_engine) - 0.5f);
+            state->camera.x = 2.0f * (random_float(random_engine) - 0.5f);
+            state->camera.y = 2.0f * (random_float(random_engine) - 0.5f);
+            state->camera.z = 2.0f * (random_float(random_engine) - 0.5f);
+            state->camera.normalize();
+        }
+        else
+        {
+            float u1 = point.next();
+            float u2 = point.next();
+            float u3 = point.next();
+            state->camera = uniform_rotation(u1, u2, u3);
+        }
+    }
+    if (fuzz->magnetometer_orientation)
+    {
+        if (fuzz->sampler == SAMPLER_RANDOM)
+        {
+            state->magnetometer_reference_frame.w = random_float(random_engine);
+            state->magnetometer_reference_frame.x = random_float(random_engine);
+            state->magnetometer_reference_frame.y = random_float(random_engine);
+            state->magnetometer_reference_frame.z = random_float(random_engine);
+            state->magnetometer_reference_frame.normalize();
+        }
+        else
+        {
+            float u1 = point.next();
+            float u2 = point.next();
+            float u3 = point.next();
+            state->magnetometer_reference_frame = uniform_rotation(u1, u2, u3);
+        }
+    }
+    if (fuzz->atmosphere_height)
+    {
+        float t = point.next();
+        state->visible_atmosphere_height = MAX_ATMOSPHERE_HEIGHT * t + MIN_ATMOSPHERE_HEIGHT * (1.0f - t);
+    }
+    if (fuzz->altitude)
+    {
+        float t = point.next();
+        state->altitude = MAX_ALTITUDE * t + MIN_ALTITUDE * (1.0f - t);
+    }
+    if (fuzz->latitude)
+    {
+        float t = point.next();
+        state->latitude = -90.0f * t + 90.0f * (1.0f - t);
+    }
+    if (fuzz->longitude)
+    {
+        float t = point.next();
+        state->longitude = -180.0f * t + 180.0f * (1.0f - t);
+    }
+    if (fuzz->noise_seed)
+    {
+        // Keep it positive, like rand() used to
+        state->noise_seed = random_engine() >> 1;
+    }
+    if (fuzz->noise_stdev)
+    {
+        float t = point.next();
+        state->noise_stdev = MAX_NOISE_STDEV * t + MIN_NOISE_STDEV * (1.0f - t);
+    }
+    if (fuzz->mag_reading)
+    {
+        std::normal_distribution<float> mag_dist(0.0f, fuzz->mag_stdev);
+        state->mag_noise.x = mag_dist(random_engine);
+        state->mag_noise.y = mag_dist(random_engine);
+        state->mag_noise.z = mag_dist(random_engine);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "sim.h"
+
+#include <stdint.h>
+
+// How the fuzzed parameters are spread over their ranges
+enum Sampler
+{
+    // Every parameter drawn independently at random, the way runs were made
+    // before there was a choice
+    SAMPLER_RANDOM,
+
+    // The enabled parameters are the dimensions of one low-discrepancy
+    // point per sample: a Sobol or Halton sequence scrambled by the fuzz
+    // seed. Any run of samples from 0 covers the space evenly, the first 2^k
+    // of a Sobol run best of all.
+    SAMPLER_SOBOL,
+    SAMPLER_HALTON,
+
+    // A Latin hypercube over every `count` samples: each parameter's range is
+    // split into `count` strata, and every stratum of every parameter gets
+    // exactly one sample, in a random pairing
+    SAMPLER_STRATIFIED
+};
+
+struct FuzzOptions
+{
+    bool orientation = false;
+    bool magnetometer_orientation = false;
+
+    bool atmosphere_height = false;
+
+    bool altitude = false;
+    bool latitude = false;
+    bool longitude = false;
+
+    bool noise_seed = false;
+    bool noise_stdev = false;
+
+    bool mag_reading = false;
+
+    float mag_stdev = DEFAULT_MAG_STDEV;
+
+    Sampler sampler = SAMPLER_RANDOM;
+
+    unsigned int seed = 1;
+    unsigned int count = 1;
+};
+
+// Randomizes the parameters selected in `fuzz`.
+// Every sample draws from its own random engine, seeded from the fuzz seed and
+// the sample's index, so sample N comes out the same no matter which thread
+// generates it or what order the samples are generated in. The sequence
+// samplers work out point N directly for the same reason.
+//
+// With any sampler but SAMPLER_RANDOM, orientations are uniform over all
+// rotations. noise_seed and mag_reading are noise rather than parameters to
+// cover, and always come from the random engine.
+void randomize_state(SimulationState* state, const FuzzOptions* fuzz, unsigned int sample_index);
@@ -0,0 +1,256 @@
+#include "geomag_batch.h"
+
+#include <cmath>
+#include <cstring>
+
+// GEOMAG_LANES doubles, operated on element-wise. GCC and clang compile these
+// to SSE2 instructions, and to scalar code on targets without SIMD.
+typedef double Lanes __attribute__((vector_size(GEOMAG_LANES * sizeof(double))));
+
+static inline int term_index(int n, int m)
+{
+    return n * (n + 1) / 2 + m;
+}
+
+bool geomag_batch_init(GeomagBatchModel* batch, const MAGtype_MagneticModel* model, const MAGtype_Ellipsoid& ellipsoid, double decimal_year)
+{
+    if (model->nMax > GEOMAG_MAX_DEGREE)
+    {
+        return false;
+    }
+
+    memset(batch, 0, sizeof(*batch));
+    batch->n_max = model->nMax;
+    batch->ellipsoid = ellipsoid;
+
+    double dt = decimal_year - model->epoch;
+    int last_secular_index = term_index(model->nMaxSecVar, model->nMaxSecVar);
+
+    // Ratio of the Schmidt quasi-normalized Legendre functions to the Gauss
+    // normalized ones, same recursion as MAG_PcupLow
+    double schmidt[GEOMAG_MAX_TERMS];
+    schmidt[0] = 1.0;
+    for (int n = 1; n <= model->nMax; ++n)
+    {
+        schmidt[term_index(n, 0)] = schmidt[term_index(n - 1, 0)] * (double)(2 * n - 1) / (double)n;
+        for (int m = 1; m <= n; ++m)
+        {
+            schmidt[term_index(n, m)] = schmidt[term_index(n, m - 1)] * sqrt((double)((n - m + 1) * (m == 1 ? 2 : 1)) / (double)(n + m));
+        }
+    }
+
+    for (int n = 1; n <= model->nMax; ++n)
+    {
+        for (int m = 0; m <= n; ++m)
+        {
+            int index = term_index(n, m);
+
+            double g = model->Main_Field_Coeff_G[index];
+            double h = model->Main_Field_Coeff_H[index];
+            if (index <= last_secular_index)
+            {
+                g += dt * model->Secular_Var_Coeff_G[index];
+                h += dt * model->Secular_Var_Coeff_H[index];
+            }
+
+            batch->g[index] = g * schmidt[index];
+            batch->h[index] = h * schmidt[index];
+            batch->k[index] = (double)((n - 1) * (n - 1) - m * m) / (double)((2 * n - 1) * (2 * n - 3));
+        }
+    }
+
+    return true;
+}
+
+// Per-point values that need libm, worked out before the SIMD part
+struct PointSetup
+{
+    double sin_latitude;
+    double cos_latitude;    // as computed in MAG_PcupLow
+    double east_divisor;    // cos(latitude) as computed in MAG_Summation
+    double cos_longitude;
+    double sin_longitude;
+    double radius_ratio;    // earth radius / r
+    double cos_psi;         // rotation from geocentric to geodetic latitude
+    double sin_psi;
+    bool at_pole;           // the east component needs MAG_SummationSpecial
+};
+
+static void setup_point(const GeomagBatchModel* batch, double latitude, double longitude, double radius, PointSetup* setup)
+{
+    MAGtype_CoordSpherical spherical_coord;
+    spherical_coord.lambda = longitude;
+    spherical_coord.phig = latitude;
+    spherical_coord.r = radius;
+
+    MAGtype_CoordGeodetic geo_coord;
+    MAG_SphericalToGeodetic(batch->ellipsoid, spherical_coord, &geo_coord);
+
+    double psi = DEG2RAD(latitude - geo_coord.phi);
+
+    setup->sin_latitude = sin(DEG2RAD(latitude));
+    setup->cos_latitude = sqrt((1.0 - setup->sin_latitude) * (1.0 + setup->sin_latitude));
+    setup->cos_longitude = cos(DEG2RAD(longitude));
+    setup->sin_longitude = sin(DEG2RAD(longitude));
+    setup->radius_ratio = batch->ellipsoid.re / radius;
+    setup->cos_psi = cos(psi);
+    setup->sin_psi = sin(psi);
+    setup->east_divisor = cos(DEG2RAD(latitude));
+    setup->at_pole = fabs(setup->east_divisor) <= 1.0e-10;
+}
+
+// East component at a geographic pole, where MAG_Summation's division by
+// cos(latitude) breaks down. Same as MAG_SummationSpecial.
+static double pole_east(const GeomagBatchModel* batch, const PointSetup& setup)
+{
+    double P_previous = 1.0;
+    double P = 1.0;
+    double radius_power = setup.radius_ratio * setup.radius_ratio;
+    double east = 0.0;
+    for (int n = 1; n <= batch->n_max; ++n)
+    {
+        int index = term_index(n, 1);
+        radius_power *= setup.radius_ratio;
+
+        if (n > 1)
+        {
+            double P_next = setup.sin_latitude * P - batch->k[index] * P_previous;
+            P_previous = P;
+            P = P_next;
+        }
+
+        east += radius_power * (batch->g[index] * setup.sin_longitude - batch->h[index] * setup.cos_longitude) * P;
+    }
+    return east;
+}
+
+// The body of MAG_AssociatedLegendreFunction, MAG_ComputeSphericalHarmonicVariables,
+// MAG_Summation and MAG_RotateMagneticVector, for GEOMAG_LANES points at once
+static void evaluate_lanes(const GeomagBatchModel* batch, const PointSetup* setup, Lanes* north, Lanes* east, Lanes* down)
+{
+    Lanes x, z, east_divisor, cos_lambda, sin_lambda, radius_ratio, cos_psi, sin_psi;
+    for (int lane = 0; lane < GEOMAG_LANES; ++lane)
+    {
+        x[lane] = setup[lane].sin_latitude;
+        z[lane] = setup[lane].cos_latitude;
+        east_divisor[lane] = setup[lane].east_divisor;
+        cos_lambda[lane] = setup[lane].cos_longitude;
+        sin_lambda[lane] = setup[lane].sin_longitude;
+        radius_ratio[lane] = setup[lane].radius_ratio;
+        cos_psi[lane] = setup[lane].cos_psi;
+        sin_psi[lane] = setup[lane].sin_psi;
+    }
+
+    const int n_max = batch->n_max;
+    const Lanes zero = {};
+
+    // Gauss-normalized Legendre functions and their derivatives with
+    // respect to colatitude (the normalization and the sign change to
+    // latitude are folded into the coefficients)
+    Lanes P[GEOMAG_MAX_TERMS];
+    Lanes dP[GEOMAG_MAX_TERMS];
+    P[0] = zero + 1.0;
+    dP[0] = zero;
+    for (int n = 1; n <= n_max; ++n)
+    {
+        int row = term_index(n, 0);
+        int previous_row = term_index(n - 1, 0);
+        for (int m = 0; m < n - 1; ++m)
+        {
+            int index = row + m;
+            int index1 = previous_row + m;
+            int index2 = term_index(n - 2, m);
+            double k = batch->k[index];
+            P[index] = x * P[index1] - k * P[index2];
+            dP[index] = x * dP[index1] - z * P[index1] - k * dP[index2];
+        }
+
+        // m = n - 1
+        int index = row + n - 1;
+        int index1 = previous_row + n - 1;
+        P[index] = x * P[index1];
+        dP[index] = x * dP[index1] - z * P[index1];
+
+        // m = n
+        index = row + n;
+        index1 = previous_row + n - 1;
+        P[index] = z * P[index1];
+        dP[index] = z * dP[index1] + x * P[index1];
+    }
+
+    Lanes cos_m_lambda[GEOMAG_MAX_DEGREE + 1];
+    Lanes sin_m_lambda[GEOMAG_MAX_DEGREE + 1];
+    cos_m_lambda[0] = zero + 1.0;
+    sin_m_lambda[0] = zero;
+    cos_m_lambda[1] = cos_lambda;
+    sin_m_lambda[1] = sin_lambda;
+    for (int m = 2; m <= n_max; ++m)
+    {
+        cos_m_lambda[m] = cos_m_lambda[m - 1] * cos_lambda - sin_m_lambda[m - 1] * sin_lambda;
+        sin_m_lambda[m] = cos_m_lambda[m - 1] * sin_lambda + sin_m_lambda[m - 1] * cos_lambda;
+    }
+
+    // Equations 10-12 of the WMM technical report, in the spherical frame
+    Lanes bx = zero;
+    Lanes by = zero;
+    Lanes bz = zero;
+    Lanes radius_power = radius_ratio * radius_ratio;
+    for (int n = 1; n <= n_max; ++n)
+    {
+        radius_power *= radius_ratio;
+
+        Lanes sum_x = zero;
+        Lanes sum_y = zero;
+        Lanes sum_z = zero;
+        for (int m = 0; m <= n; ++m)
+        {
+            int index = term_index(n, m);
+            double g = batch->g[index];
+            double h = batch->h[index];
+
+            Lanes a = g * cos_m_lambda[m] + h * sin_m_lambda[m];
+            Lanes b = g * sin_m_lambda[m] - h * cos_m_lambda[m];
+
+            sum_x += a * dP[index];
+            sum_y += b * ((double)m * P[index]);
+            sum_z += a * P[index];
+        }
+
+        bx += radius_power * sum_x;
+        by += radius_power * sum_y;
+        bz -= radius_power * ((double)(n + 1) * sum_z);
+    }
+    by /= east_divisor;
+
+    *north = bx * cos_psi - bz * sin_psi;
+    *east = by;
+    *down = bx * sin_psi + bz * cos_psi;
+}
+
+void geomag_batch_evaluate(const GeomagBatchModel* batch, size_t count,
+                           const double* latitude, const double* longitude, const double* radius,
+                           double* north, double* east, double* down)
+{
+    for (size_t first = 0; first < count; first += GEOMAG_LANES)
+    {
+        size_t lanes_used = count - first < GEOMAG_LANES ? count - first : GEOMAG_LANES;
+
+        // A partial group repeats its last point in the unused lanes
+        PointSetup setup[GEOMAG_LANES];
+        for (size_t lane = 0; lane < GEOMAG_LANES; ++lane)
+        {
+            size_t i = first + (lane < lanes_used ? lane : lanes_used - 1);
+            setup_point(batch, latitude[i], longitude[i], radius[i], &setup[lane]);
+        }
+
+        Lanes x, y, z;
+        evaluate_lanes(batch, setup, &x, &y, &z);
+
+        for (size_t lane = 0; lane < lanes_used; ++lane)
+        {
+            north[first + lane] = x[lane];
+            east[first + lane] = setup[lane].at_pole ? pole_east(batch, setup[lane]) : y[lane];
+            down[first + lane] = z[lane];
+        }
+    }
+}
@@ -0,0 +1,157 @@
+// Checks the compiled in WMM coefficients against WMM_2020/WMM.COF, and
+// geomag_batch_evaluate against the WMM library, and times both.
+//
+// Usage: ./geomag_check [points]
+//
+// Points are spread over the whole globe from the surface up to 2000 km, plus
+// both poles and the date line. Exits with an error if any field component
+// differs from MAG_Geomag by more than 0.1 nT.
+
+#include "geomag_batch.h"
+#include "wmm_embedded.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const double TOLERANCE_NT = 0.1;
+
+int main(int argc, char** args)
+{
+    size_t count = argc > 1 ? atoi(args[1]) : 100000;
+    if (count == 0)
+    {
+        cout << "Usage: ./geomag_check [points]" << endl;
+        return 1;
+    }
+
+    char wmm_coeff_filename[] = "WMM_2020/WMM.COF";
+    MAGtype_MagneticModel* magnetic_models[1];
+    MAGtype_MagneticModel** magnetic_models_ptr = magnetic_models;
+    if (!MAG_robustReadMagModels(wmm_coeff_filename, &magnetic_models_ptr, 1))
+    {
+        cerr << "Magnetic field coefficients file WMM_2020/WMM.COF not found." << endl;
+        return 1;
+    }
+    MAGtype_Ellipsoid ellipsoid;
+    MAGtype_Geoid geoid;
+    MAG_SetDefaults(&ellipsoid, &geoid);
+
+    // The generator uses the compiled in coefficients, which have to match
+    // the file exactly
+    MAGtype_MagneticModel* model = wmm_embedded_model();
+    MAGtype_MagneticModel* file_model = magnetic_models[0];
+    if (model->nMax != file_model->nMax || model->epoch != file_model->epoch
+        || memcmp(model->Main_Field_Coeff_G, file_model->Main_Field_Coeff_G, (CALCULATE_NUMTERMS(model->nMax) + 1) * sizeof(double)) != 0
+        || memcmp(model->Main_Field_Coeff_H, file_model->Main_Field_Coeff_H, (CALCULATE_NUMTERMS(model->nMax) + 1) * sizeof(double)) != 0
+        || memcmp(model->Secular_Var_Coeff_G, file_model->Secular_Var_Coeff_G, (CALCULATE_NUMTERMS(model->nMax) + 1) * sizeof(double)) != 0
+        || memcmp(model->Secular_Var_Coeff_H, file_model->Secular_Var_Coeff_H, (CALCULATE_NUMTERMS(model->nMax) + 1) * sizeof(double)) != 0)
+    {
+        cerr << "Compiled in coefficients don't match " << wmm_coeff_filename << endl;
+        return 1;
+    }
+    cout << "Compiled in coefficients match " << wmm_coeff_filename << endl;
+    MAG_FreeMagneticModelMemory(file_model);
+
+    // Checked both untimed, as compute_outputs uses it, and part way through
+    // the model's validity period
+    double decimal_years[] = { model->epoch, model->epoch + 2.5 };
+
+    std::vector<double> latitude, longitude, radius;
+    double fixed_latitudes[] = { 90.0, -90.0, 89.99999, -89.99999, 0.0 };
+    double fixed_longitudes[] = { -180.0, 0.0, 180.0 };
+    for (double lat : fixed_latitudes)
+    {
+        for (double lon : fixed_longitudes)
+        {
+            latitude.push_back(lat);
+            longitude.push_back(lon);
+            radius.push_back(6371.0 + 500.0);
+        }
+    }
+
+    std::mt19937 engine(1);
+    std::uniform_real_distribution<double> latitude_dist(-90.0, 90.0);
+    std::uniform_real_distribution<double> longitude_dist(-180.0, 180.0);
+    std::uniform_real_distribution<double> altitude_dist(0.0, 2000.0);
+    while (latitude.size() < count)
+    {
+        latitude.push_back(latitude_dist(engine));
+        longitude.push_back(longitude_dist(engine));
+        radius.push_back(6371.0 + altitude_dist(engine));
+    }
+    count = latitude.size();
+
+    std::vector<double> north(count), east(count), down(count);
+    bool ok = true;
+
+    for (double decimal_year : decimal_years)
+    {
+        MAGtype_MagneticModel* timed_model = MAG_AllocateModelMemory((model->nMax + 1) * (model->nMax + 2) / 2);
+        MAGtype_Date date;
+        date.DecimalYear = decimal_year;
+        MAG_TimelyModifyMagneticModel(date, model, timed_model);
+
+        GeomagBatchModel batch;
+        if (!geomag_batch_init(&batch, model, ellipsoid, decimal_year))
+        {
+            cerr << "Model degree " << model->nMax << " is higher than GEOMAG_MAX_DEGREE" << endl;
+            return 1;
+        }
+
+        auto batch_start = std::chrono::steady_clock::now();
+        geomag_batch_evaluate(&batch, count, latitude.data(), longitude.data(), radius.data(), north.data(), east.data(), down.data());
+        std::chrono::duration<double, std::nano> batch_time = std::chrono::steady_clock::now() - batch_start;
+
+        double worst = 0.0;
+        size_t worst_index = 0;
+        std::chrono::duration<double, std::nano> reference_time(0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            MAGtype_CoordSpherical spherical_coord;
+            MAGtype_CoordGeodetic geo_coord;
+            MAGtype_GeoMagneticElements magnetic_field;
+            spherical_coord.lambda = longitude[i];
+            spherical_coord.phig = latitude[i];
+            spherical_coord.r = radius[i];
+
+            auto reference_start = std::chrono::steady_clock::now();
+            MAG_SphericalToGeodetic(ellipsoid, spherical_coord, &geo_coord);
+            MAG_Geomag(ellipsoid, spherical_coord, geo_coord, timed_model, &magnetic_field);
+            reference_time += std::chrono::steady_clock::now() - reference_start;
+
+            double error = fmax(fabs(north[i] - magnetic_field.X), fmax(fabs(east[i] - magnetic_field.Y), fabs(down[i] - magnetic_field.Z)));
+            if (error > worst)
+            {
+                worst = error;
+                worst_index = i;
+            }
+        }
+
+        cout << "Decimal year " << decimal_year << ", " << count << " points" << endl;
+        cout << "    worst difference " << worst << " nT at latitude " << latitude[worst_index]
+             << ", longitude " << longitude[worst_index] << ", radius " << radius[worst_index] << endl;
+        cout << "    MAG_Geomag:            " << reference_time.count() / count << " ns/point" << endl;
+        cout << "    geomag_batch_evaluate: " << batch_time.count() / count << " ns/point ("
+             << reference_time.count() / batch_time.count() << "x)" << endl;
+
+        if (worst > TOLERANCE_NT)
+        {
+            cerr << "Difference is over " << TOLERANCE_NT << " nT" << endl;
+            ok = false;
+        }
+
+        MAG_FreeMagneticModelMemory(timed_model);
+    }
+
+    MAG_FreeMagneticModelMemory(model);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#include "geomag_grid.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int geomag_grid_open(GeomagGrid* grid, const char* filename)
+{
+    memset(grid, 0, sizeof(*grid));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(GeomagGridHeader))
+    {
+        fprintf(stderr, "%s is too small to be a geomagnetic grid\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    grid->data = (const uint8_t*)data;
+    grid->size = file_stat.st_size;
+    grid->header = (const GeomagGridHeader*)data;
+    grid->field = (const float*)(grid->data + grid->header->data_offset);
+
+    const GeomagGridHeader* header = grid->header;
+    const char* problem = NULL;
+    if (memcmp(header->magic, GEOMAG_GRID_MAGIC, sizeof(GEOMAG_GRID_MAGIC)) != 0)
+    {
+        problem = "is not a geomagnetic grid";
+    }
+    else if (header->version != GEOMAG_GRID_VERSION)
+    {
+        problem = "is from an incompatible version";
+    }
+    else if (header->latitude_count < 2 || header->longitude_count < 2 || header->altitude_count < 2)
+    {
+        problem = "needs at least two points on each axis";
+    }
+    else if (header->data_offset + (uint64_t)header->latitude_count * header->longitude_count * header->altitude_count * 3 * sizeof(float) > grid->size)
+    {
+        problem = "is truncated";
+    }
+
+    if (problem)
+    {
+        fprintf(stderr, "%s %s\n", filename, problem);
+        geomag_grid_close(grid);
+        return -1;
+    }
+
+    return 0;
+}
+
+void geomag_grid_close(GeomagGrid* grid)
+{
+    if (grid->data)
+    {
+        munmap((void*)grid->data, grid->size);
+    }
+    memset(grid, 0, sizeof(*grid));
+}
+
+// Splits a coordinate into the index of the grid cell it's in and the
+// fraction of the way across that cell. Returns -1 if it's outside the grid.
+static int grid_cell(float value, float min, float step, uint32_t count, uint32_t* index, float* fraction)
+{
+    float position = (value - min) / step;
+    if (!(position >= 0.0f && position <= (float)(count - 1)))
+    {
+        return -1;
+    }
+
+    uint32_t cell = (uint32_t)position;
+    if (cell > count - 2)
+    {
+        cell = count - 2;
+    }
+    *index = cell;
+    *fraction = position - (float)cell;
+    return 0;
+}
+
+int geomag_grid_lookup(const GeomagGrid* grid, float latitude, float longitude, float altitude, float field[3])
+{
+    const GeomagGridHeader* header = grid->header;
+
+    // Bring longitude into the range the grid covers, which is assumed to be
+    // a full turn
+    float longitude_offset = fmodf(longitude - header->longitude_min, 360.0f);
+    if (longitude_offset < 0.0f)
+    {
+        longitude_offset += 360.0f;
+    }
+
+    uint32_t i, j, k;
+    float t_lat, t_lon, t_alt;
+    if (grid_cell(altitude, header->altitude_min, header->altitude_step, header->altitude_count, &k, &t_alt) != 0
+        || grid_cell(latitude, header->latitude_min, header->latitude_step, header->latitude_count, &i, &t_lat) != 0
+        || grid_cell(header->longitude_min + longitude_offset, header->longitude_min, header->longitude_step, header->longitude_count, &j, &t_lon) != 0)
+    {
+        return -1;
+    }
+
+    const size_t lon_stride = 3;
+    const size_t lat_stride = lon_stride * header->longitude_count;
+    const size_t alt_stride = lat_stride * header->latitude_count;
+    const float* corner = grid->field + k * alt_stride + i * lat_stride + j * lon_stride;
+
+    for (int c = 0; c < 3; ++c)
+    {
+        const float* p = corner + c;
+        float v00 = p[0] + t_lon * (p[lon_stride] - p[0]);
+        float v01 = p[lat_stride] + t_lon * (p[lat_stride + lon_stride] - p[lat_stride]);
+        float v10 = p[alt_stride] + t_lon * (p[alt_stride + lon_stride] - p[alt_stride]);
+        float v11 = p[alt_stride + lat_stride] + t_lon * (p[alt_stride + lat_stride + lon_stride] - p[alt_stride + lat_stride]);
+
+        float v0 = v00 + t_lat * (v01 - v00);
+        float v1 = v10 + t_lat * (v11 - v10);
+        field[c] = v0 + t_alt * (v1 - v0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef GEOMAG_GRID_H
+#define GEOMAG_GRID_H
+
+// Precomputed geomagnetic field grid (.hrzgeo)
+//
+// A table of WMM field vectors on a regular (altitude, latitude, longitude)
+// grid, made by build_geomag_grid, so the field can be found by trilinear
+// interpolation instead of a full spherical harmonic evaluation. The file is
+// laid out to be mmapped and used in place:
+//
+//   offset 0             GeomagGridHeader, padded to GEOMAG_GRID_ALIGNMENT
+//   data_offset          float[altitude_count][latitude_count][longitude_count][3]
+//                        north, east and down field components in nT
+//
+// Coordinates follow compute_outputs: geocentric latitude and longitude in
+// degrees, and altitude in km above EARTH_RADIUS. The header records the
+// worst interpolation error measured against MAG_Geomag when the grid was
+// built.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GEOMAG_GRID_MAGIC "HRZGEO"
+#define GEOMAG_GRID_VERSION 1
+#define GEOMAG_GRID_ALIGNMENT 4096
+
+#pragma pack(push, 1)
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+
+    uint32_t latitude_count;
+    uint32_t longitude_count;
+    uint32_t altitude_count;
+
+    float latitude_min;
+    float latitude_step;
+    float longitude_min;
+    float longitude_step;
+    float altitude_min;
+    float altitude_step;
+
+    // Decimal year the model was evaluated at
+    double model_year;
+
+    // Largest and RMS difference from MAG_Geomag of any field component, in
+    // nT, over the random points checked by build_geomag_grid
+    float max_error;
+    float rms_error;
+
+    uint64_t data_offset;
+} GeomagGridHeader;
+#pragma pack(pop)
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t size;
+    const GeomagGridHeader* header;
+    const float* field;
+} GeomagGrid;
+
+// Maps a grid file. Returns 0 on success.
+int geomag_grid_open(GeomagGrid* grid, const char* filename);
+void geomag_grid_close(GeomagGrid* grid);
+
+// Interpolates the field (north, east, down, in nT) at a point.
+// Longitude wraps around. Returns 0 on success, or -1 if the latitude or
+// altitude is outside the grid.
+int geomag_grid_lookup(const GeomagGrid* grid, float latitude, float longitude, float altitude, float field[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // include guard
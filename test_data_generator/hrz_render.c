@@ -0,0 +1,136 @@
+// Renders .hrz files with libhrzgen (see hrzgen.h).
+//
+// Usage: ./hrz_render [--offscreen] [--sensor name] <file.hrz>...
+//
+// Writes each frame next to its state, as <file>.bin in the same format as
+// test_image_generator's uint16 exports. Frames are rendered by the cpu
+// renderer unless --offscreen is given. Prints how long setting up the
+// library took and the time per frame. Exits with 1 if any file couldn't be
+// loaded, rendered or written.
+//
+// It's a plain C program linked against libhrzgen, without SDL or a window,
+// the same as any other program generating frames in-process.
+
+#include "hrzgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double seconds_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void usage(void)
+{
+    printf("Usage: ./hrz_render [--offscreen] [--sensor name] <file.hrz>...\n");
+    exit(1);
+}
+
+int main(int argc, char** args)
+{
+    HrzgenRenderer renderer = HRZGEN_RENDERER_CPU;
+    const char* sensor = NULL;
+
+    int arg_index = 1;
+    for (; arg_index < argc && strncmp(args[arg_index], "--", 2) == 0; ++arg_index)
+    {
+        if (strcmp(args[arg_index], "--offscreen") == 0)
+        {
+            renderer = HRZGEN_RENDERER_OFFSCREEN;
+        }
+        else if (strcmp(args[arg_index], "--sensor") == 0 && arg_index + 1 < argc)
+        {
+            sensor = args[++arg_index];
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (arg_index == argc)
+    {
+        usage();
+    }
+
+    double start = seconds_now();
+    HrzgenContext* context = hrzgen_create(renderer, sensor);
+    if (!context)
+    {
+        return 1;
+    }
+    double created = seconds_now();
+
+    size_t pixel_count = (size_t)hrzgen_width(context) * hrzgen_height(context);
+    uint16_t* pixels = malloc(pixel_count * sizeof(uint16_t));
+    if (!pixels)
+    {
+        perror("Allocating a frame");
+        hrzgen_destroy(context);
+        return 1;
+    }
+
+    // Only frames that made it to disk are counted, anything else fails the
+    // run once the rest are done
+    int frames = 0;
+    int failures = 0;
+    for (; arg_index < argc; ++arg_index)
+    {
+        const char* filename = args[arg_index];
+        if (hrzgen_load_state(context, filename) != 0
+            || hrzgen_render(context, pixels, pixel_count) != 0)
+        {
+            ++failures;
+            continue;
+        }
+
+        // <file>.hrz -> <file>.bin
+        size_t length = strlen(filename);
+        if (length > 4 && strcmp(filename + length - 4, ".hrz") == 0)
+        {
+            length -= 4;
+        }
+        char* bin_filename = malloc(length + 5);
+        if (!bin_filename)
+        {
+            perror(filename);
+            ++failures;
+            continue;
+        }
+        memcpy(bin_filename, filename, length);
+        strcpy(bin_filename + length, ".bin");
+
+        FILE* file = fopen(bin_filename, "wb");
+        int written = file && fwrite(pixels, sizeof(uint16_t), pixel_count, file) == pixel_count;
+        if (file && fclose(file) != 0)
+        {
+            written = 0;
+        }
+        if (written)
+        {
+            ++frames;
+        }
+        else
+        {
+            perror(bin_filename);
+            ++failures;
+        }
+        free(bin_filename);
+    }
+    double end = seconds_now();
+
+    printf("Set up in %.1f ms, rendered %d frames at %.3f ms each\n", (created - start) * 1e3, frames,
+           frames ? (end - created) * 1e3 / frames : 0.0);
+    if (failures)
+    {
+        fprintf(stderr, "%d of the files couldn't be rendered\n", failures);
+    }
+
+    free(pixels);
+    hrzgen_destroy(context);
+    return failures ? 1 : 0;
+}
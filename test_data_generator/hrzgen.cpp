@@ -0,0 +1,186 @@
+#include "hrzgen.h"
+#include "capture.h"
+#include "export.h"
+#include "outputs.h"
+#include "rendering.h"
+#include "sensor.h"
+
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+
+struct HrzgenContext
+{
+    RenderState render_state;
+    FrameCapture capture;
+    CapturedFrame frame;
+    GeomagnetismData geomag;
+    SimulationState state;
+};
+
+HrzgenContext* hrzgen_create(HrzgenRenderer renderer, const char* sensor)
+{
+    const SensorProfile* profile = find_sensor_profile(sensor ? sensor : "lepton3.5");
+    if (!profile)
+    {
+        cerr << "Unknown sensor " << sensor << endl;
+        return nullptr;
+    }
+
+    HrzgenContext* context = new HrzgenContext;
+    apply_sensor_profile(&context->state, *profile);
+
+    if (!geomag_init(&context->geomag, nullptr))
+    {
+        delete context;
+        return nullptr;
+    }
+
+    Renderer render = renderer == HRZGEN_RENDERER_OFFSCREEN ? RENDERER_GL_OFFSCREEN : RENDERER_CPU;
+    if (!render_open(&context->render_state, render, profile->width, profile->height))
+    {
+        geomag_cleanup(&context->geomag);
+        delete context;
+        return nullptr;
+    }
+    capture_init(&context->capture, &context->render_state);
+
+    return context;
+}
+
+void hrzgen_destroy(HrzgenContext* context)
+{
+    if (!context)
+    {
+        return;
+    }
+    capture_cleanup(&context->capture);
+    render_cleanup(&context->render_state);
+    geomag_cleanup(&context->geomag);
+    delete context;
+}
+
+uint32_t hrzgen_width(const HrzgenContext* context)
+{
+    return context->state.sensor_width;
+}
+
+uint32_t hrzgen_height(const HrzgenContext* context)
+{
+    return context->state.sensor_height;
+}
+
+uint32_t hrzgen_bit_depth(const HrzgenContext* context)
+{
+    return context->state.bit_depth;
+}
+
+static void get_quaternion(const Quaternion& q, float* out)
+{
+    out[0] = q.w;
+    out[1] = q.x;
+    out[2] = q.y;
+    out[3] = q.z;
+}
+
+static void set_quaternion(Quaternion* q, const float* in)
+{
+    q->w = in[0];
+    q->x = in[1];
+    q->y = in[2];
+    q->z = in[3];
+}
+
+void hrzgen_get_inputs(const HrzgenContext* context, HrzgenInputs* inputs)
+{
+    const SimulationState& state = context->state;
+    get_quaternion(state.camera, inputs->camera);
+    get_quaternion(state.magnetometer_reference_frame, inputs->magnetometer_reference_frame);
+    inputs->altitude = state.altitude;
+    inputs->latitude = state.latitude;
+    inputs->longitude = state.longitude;
+    inputs->noise_seed = state.noise_seed;
+    inputs->noise_stdev = state.noise_stdev;
+    inputs->visible_atmosphere_height = state.visible_atmosphere_height;
+    inputs->mag_noise[0] = state.mag_noise.x;
+    inputs->mag_noise[1] = state.mag_noise.y;
+    inputs->mag_noise[2] = state.mag_noise.z;
+    inputs->K1 = state.K1;
+    inputs->K2 = state.K2;
+}
+
+void hrzgen_set_inputs(HrzgenContext* context, const HrzgenInputs* inputs)
+{
+    SimulationState& state = context->state;
+    set_quaternion(&state.camera, inputs->camera);
+    set_quaternion(&state.magnetometer_reference_frame, inputs->magnetometer_reference_frame);
+    state.altitude = inputs->altitude;
+    state.latitude = inputs->latitude;
+    state.longitude = inputs->longitude;
+    state.noise_seed = inputs->noise_seed;
+    state.noise_stdev = inputs->noise_stdev;
+    state.visible_atmosphere_height = inputs->visible_atmosphere_height;
+    state.mag_noise = Vec3(inputs->mag_noise[0], inputs->mag_noise[1], inputs->mag_noise[2]);
+    state.K1 = inputs->K1;
+    state.K2 = inputs->K2;
+}
+
+int hrzgen_load_state(HrzgenContext* context, const char* filename)
+{
+    SimulationState state;
+    if (!state.load_state(filename))
+    {
+        return -1;
+    }
+    if (state.sensor_width != context->state.sensor_width || state.sensor_height != context->state.sensor_height)
+    {
+        cerr << filename << " is for " << state.sensor_name << ", " << state.sensor_width << "x" << state.sensor_height
+             << ", not " << context->state.sensor_name << endl;
+        return -1;
+    }
+    context->state = state;
+    return 0;
+}
+
+int hrzgen_save_state(HrzgenContext* context, const char* filename)
+{
+    compute_outputs(&context->state, context->geomag);
+    return context->state.save_state(filename) ? 0 : -1;
+}
+
+void hrzgen_compute_outputs(HrzgenContext* context, HrzgenOutputs* outputs)
+{
+    SimulationState& state = context->state;
+    compute_outputs(&state, context->geomag);
+
+    outputs->nadir[0] = state.nadir.x;
+    outputs->nadir[1] = state.nadir.y;
+    outputs->nadir[2] = state.nadir.z;
+    outputs->magnetic_field[0] = state.magnetic_field.x;
+    outputs->magnetic_field[1] = state.magnetic_field.y;
+    outputs->magnetic_field[2] = state.magnetic_field.z;
+    outputs->magnetometer[0] = state.magnetometer.x;
+    outputs->magnetometer[1] = state.magnetometer.y;
+    outputs->magnetometer[2] = state.magnetometer.z;
+    for (int i = 0; i < 16; ++i)
+    {
+        outputs->magnetometer_transformation[i] = state.magnetometer_transformation[i];
+    }
+}
+
+int hrzgen_render(HrzgenContext* context, uint16_t* pixels, size_t pixel_count)
+{
+    if (pixel_count < sensor_pixels(context->state))
+    {
+        return -1;
+    }
+
+    // The renderers draw from the nadir vector, which is an output
+    compute_outputs(&context->state, context->geomag);
+
+    capture_submit(&context->capture, context->state, 0);
+    capture_retrieve(&context->capture, &context->frame);
+    frame_to_lepton(context->frame, pixels);
+    return 0;
+}
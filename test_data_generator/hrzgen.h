@@ -0,0 +1,113 @@
+#ifndef HRZGEN_H
+#define HRZGEN_H
+
+// libhrzgen: the generator without its GUI
+//
+// The renderers, sensor noise, lens distortion and ground truth of
+// test_image_generator behind a small C API, so other programs (batch tools,
+// the detector's test harness, Python through ctypes) can make frames
+// in-process. Nothing here needs SDL, ImGui or a window: the cpu renderer
+// needs no GPU at all, and the offscreen one draws through a surfaceless EGL
+// context.
+//
+// A context holds one sample's state, starting from the defaults in
+// constants.h with the chosen sensor profile. Set its inputs, then render it
+// or compute its ground truth:
+//
+//   HrzgenContext* context = hrzgen_create(HRZGEN_RENDERER_CPU, NULL);
+//   HrzgenInputs inputs;
+//   hrzgen_get_inputs(context, &inputs);
+//   inputs.altitude = 550.0f;
+//   hrzgen_set_inputs(context, &inputs);
+//   hrzgen_render(context, pixels, pixel_count);
+//   hrzgen_destroy(context);
+//
+// Frames come out exactly as test_image_generator exports them with the same
+// renderer. Offscreen contexts must only be used on the thread that created
+// them; several contexts can work in parallel on different threads.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HrzgenContext HrzgenContext;
+
+typedef enum
+{
+    HRZGEN_RENDERER_CPU,        // cpu_renderer.cpp, in software
+    HRZGEN_RENDERER_OFFSCREEN   // screen_shader.frag through EGL
+} HrzgenRenderer;
+
+// The parameters of a sample, as in the inputs of a .hrz file (sim.h).
+// Quaternions are w, x, y, z.
+typedef struct
+{
+    float camera[4];
+    float magnetometer_reference_frame[4];
+
+    float altitude;     // km
+    float latitude;     // degrees
+    float longitude;    // degrees
+
+    int32_t noise_seed;
+    float noise_stdev;  // fraction of full scale
+
+    float visible_atmosphere_height;    // km
+
+    float mag_noise[3]; // added to the magnetometer reading, in LSBs
+
+    // Lens distortion, the sensor profile's unless changed
+    float K1;
+    float K2;
+} HrzgenInputs;
+
+// The ground truth that goes with a sample's inputs
+typedef struct
+{
+    float nadir[3];             // unit vector in the camera frame
+    float magnetic_field[3];    // nGauss, in the camera frame
+    int16_t magnetometer[3];    // reading, in the magnetometer frame
+
+    // magnetometer_reference_frame as a 4x4 matrix
+    float magnetometer_transformation[16];
+} HrzgenOutputs;
+
+// Makes a context for frames from `sensor`, one of the profiles in
+// sensor.cpp, or the Lepton 3.5 if it's NULL. Returns NULL, having printed
+// why, if the sensor or renderer isn't available.
+HrzgenContext* hrzgen_create(HrzgenRenderer renderer, const char* sensor);
+void hrzgen_destroy(HrzgenContext* context);
+
+// Size of the frames hrzgen_render makes, and the bit depth of their pixels
+uint32_t hrzgen_width(const HrzgenContext* context);
+uint32_t hrzgen_height(const HrzgenContext* context);
+uint32_t hrzgen_bit_depth(const HrzgenContext* context);
+
+void hrzgen_get_inputs(const HrzgenContext* context, HrzgenInputs* inputs);
+void hrzgen_set_inputs(HrzgenContext* context, const HrzgenInputs* inputs);
+
+// Reads a .hrz file into the context's state. Returns 0 on success, or -1 if
+// the file can't be read or is for a different sensor.
+int hrzgen_load_state(HrzgenContext* context, const char* filename);
+
+// Computes the ground truth and writes the whole state, inputs and outputs,
+// as a .hrz file. Returns 0 on success.
+int hrzgen_save_state(HrzgenContext* context, const char* filename);
+
+// Works out the ground truth of the current inputs
+void hrzgen_compute_outputs(HrzgenContext* context, HrzgenOutputs* outputs);
+
+// Renders the current inputs into `pixels`, which has room for
+// `pixel_count` of them: hrzgen_width x hrzgen_height pixels of
+// hrzgen_bit_depth bits, top row first, the same as a .bin file. Returns 0 on
+// success, or -1 if `pixels` is too small.
+int hrzgen_render(HrzgenContext* context, uint16_t* pixels, size_t pixel_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // include guard
@@ -3,137 +3,109 @@
 
 #include "math3d.h"
 #include "rendering.h"
+#include "window.h"
 #include "keyboard.h"
+#include "fuzz.h"
+#include "trajectory.h"
+#include "capture.h"
+#include "export.h"
+#include "output_queue.h"
+#include "render_cache.h"
+#include "dataset.h"
+#include "state_columns.h"
+#include "frame_ring.h"
+#include "outputs.h"
+#include "profiler.h"
+#include "sensor.h"
+#include "detection.h"
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_sdl.h"
 #include "imgui/imgui_impl_opengl3.h"
 
-extern "C" {
-#include "WMM_2020/GeomagnetismHeader.h"
-}
-
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <chrono>
 #include <string> // For std::stof
-#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstring>
 
 using std::cout;
 using std::cerr;
 using std::endl;
 
+// The window is at least this big, and grows to fit bigger sensors' frames
 const uint32_t SCREEN_WIDTH_PIXELS = 800;
 const uint32_t SCREEN_HEIGHT_PIXELS = 600;
 
-struct FuzzOptions
+// A --stream that doesn't drop frames gives up once the consumer hasn't
+// freed a slot for this long, rather than waiting forever for one that
+// isn't there
+const int STREAM_TIMEOUT_MS = 10000;
+
+struct CommandLineOptions
 {
-    bool orientation = false;;
-    bool magnetometer_orientation = false;
+    SimulationState loaded_state;
+    FuzzOptions fuzz;
+    Trajectory trajectory;
+    char* export_filename = nullptr;
+    char* pack_filename = nullptr;
+    char* columns_filename = nullptr;
+    RawFormat raw_format = RAW_PACKED14;
+    char* geomag_grid_filename = nullptr;
 
-    bool atmosphere_height = false;
+    // --cache reuses frames rendered by earlier runs (see render_cache.h)
+    char* cache_dir = nullptr;
 
-    bool altitude = false;
-    bool latitude = false;
-    bool longitude = false;
+    Renderer renderer = RENDERER_GL;
 
-    bool noise_seed = false;
-    bool noise_stdev = false;
+    // --sensor replaces the loaded state's sensor, whichever comes first
+    const SensorProfile* sensor = nullptr;
 
-    bool mag_reading = false;
+    unsigned int jobs = 1;
+    unsigned int writers = 2;
+    unsigned int queue_depth = 32;
+    unsigned int batch = RENDER_BATCH_MAX;
 
-    float mag_stdev = DEFAULT_MAG_STDEV;
+    // --bench renders this many samples without writing anything
+    unsigned int bench = 0;
+    bool profile = false;
 
-    unsigned int seed = 1;
-    unsigned int count = 1;
+    // --shard k/N makes only the samples whose index is k mod N
+    unsigned int shard_index = 0;
+    unsigned int shard_count = 1;
 
-    std::default_random_engine mag_random_engine;
-    std::normal_distribution<float> mag_dist;
+    // --stream publishes frames into a shared memory ring (see frame_ring.h)
+    char* stream_name = nullptr;
+    unsigned int stream_slots = 64;
+    bool stream_drop = false;
 };
 
-float random_float()
+// Number of samples this process makes out of the whole fuzz run
+static unsigned int shard_samples(const CommandLineOptions& options)
 {
-    return (float)rand() / (float)RAND_MAX;
-}
-
-void export_all(std::string filename, RenderState render_state, SimulationState sim_state)
-{
-    std::string png_filename = filename + std::string(".png");
-    std::string bin_filename = filename + std::string(".bin");
-    std::string hrz_filename = filename + std::string(".hrz");
-
-    export_image(png_filename.c_str(), render_state, sim_state);
-    export_binary(bin_filename.c_str(), render_state, sim_state);
-    sim_state.save_state(hrz_filename.c_str());
-}
-
-void randomize_state(SimulationState* state, FuzzOptions* fuzz)
-{
-    if (fuzz->orientation)
-    {
-        state->camera.w = 2.0f * (random_float() - 0.5f);
-        state->camera.x = 2.0f * (random_float() - 0.5f);
-        state->camera.y = 2.0f * (random_float() - 0.5f);
-        state->camera.z = 2.0f * (random_float() - 0.5f);
-        state->camera.normalize();
-    }
-    if (fuzz->magnetometer_orientation)
-    {
-        state->magnetometer_reference_frame.w = random_float();
-        state->magnetometer_reference_frame.x = random_float();
-        state->magnetometer_reference_frame.y = random_float();
-        state->magnetometer_reference_frame.z = random_float();
-        state->magnetometer_reference_frame.normalize();
-    }
-    if (fuzz->atmosphere_height)
-    {
-        float t = random_float();
-        state->visible_atmosphere_height = MAX_ATMOSPHERE_HEIGHT * t + MIN_ATMOSPHERE_HEIGHT * (1.0f - t);
-    }
-    if (fuzz->altitude)
-    {
-        float t = random_float();
-        state->altitude = MAX_ALTITUDE * t + MIN_ALTITUDE * (1.0f - t);
-    }
-    if (fuzz->latitude)
-    {
-        float t = random_float();
-        state->latitude = -90.0f * t + 90.0f * (1.0f - t);
-    }
-    if (fuzz->longitude)
-    {
-        float t = random_float();
-        state->longitude = -180.0f * t + 180.0f * (1.0f - t);
-    }
-    if (fuzz->noise_seed)
-    {
-        // The scaling factor is arbitrary, possibly unnecessary.
-        state->noise_seed = rand();
-    }
-    if (fuzz->noise_stdev)
-    {
-        float t = random_float();
-        state->noise_stdev = MAX_NOISE_STDEV * t + MIN_NOISE_STDEV * (1.0f - t);
-    }
-    if (fuzz->mag_reading)
+    if (options.shard_index >= options.fuzz.count)
     {
-        fuzz->mag_dist.param(decltype(fuzz->mag_dist)::param_type(0.0f, fuzz->mag_stdev));
-        state->mag_noise.x = fuzz->mag_dist(fuzz->mag_random_engine);
-        state->mag_noise.y = fuzz->mag_dist(fuzz->mag_random_engine);
-        state->mag_noise.z = fuzz->mag_dist(fuzz->mag_random_engine);
+        return 0;
     }
+    return (options.fuzz.count - options.shard_index + options.shard_count - 1) / options.shard_count;
 }
 
-struct CommandLineOptions
-{
-    SimulationState loaded_state;
-    FuzzOptions fuzz;
-    char* export_filename = nullptr;
-};
-
 void usage()
 {
-    cout << "Usage: ./test_image_generator [--load filename] [--export filename] [--fuzz <fuzz options> end]" << endl;
+    cout << "Usage: ./test_image_generator [--load filename] [--export filename] [--pack filename] [--columns filename] [--raw_format packed14|uint16|irc] [--geomag_grid filename] [--cache directory] [--fuzz <fuzz options> end] [--sampler random|sobol|halton|stratified] [--renderer gl|offscreen|cpu] [--sensor name] [--jobs N] [--writers N] [--queue_depth N] [--batch N] [--bench N] [--profile] [--shard k/N] [--stream /name] [--stream_slots N] [--stream_drop] [--trajectory N] [--frame_rate hz] [--inclination degrees] [--eccentricity e] [--body_rates x y z] [--jitter degrees]" << endl;
+    cout << "Sensors:";
+    for (unsigned int i = 0; i < SENSOR_PROFILE_COUNT; ++i)
+    {
+        cout << " " << SENSOR_PROFILES[i].name;
+    }
+    cout << endl;
     exit(1);
 }
 
@@ -164,6 +136,67 @@ CommandLineOptions parse_args(int argc, char** args)
             }
             options.export_filename = args[arg_index];
         }
+        else if (strcmp("--pack", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            options.pack_filename = args[arg_index];
+        }
+        else if (strcmp("--columns", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            options.columns_filename = args[arg_index];
+        }
+        else if (strcmp("--raw_format", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            if (strcmp("packed14", args[arg_index]) == 0)
+            {
+                options.raw_format = RAW_PACKED14;
+            }
+            else if (strcmp("uint16", args[arg_index]) == 0)
+            {
+                options.raw_format = RAW_UINT16;
+            }
+            else if (strcmp("irc", args[arg_index]) == 0)
+            {
+                options.raw_format = RAW_IRC;
+            }
+            else
+            {
+                cout << "Unknown raw format" << endl;
+                exit(1);
+            }
+        }
+        else if (strcmp("--geomag_grid", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            options.geomag_grid_filename = args[arg_index];
+        }
+        else if (strcmp("--cache", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            options.cache_dir = args[arg_index];
+        }
         else if (strcmp("--fuzz_options", args[arg_index]) == 0)
         {
             while (arg_index < argc)
@@ -233,6 +266,35 @@ CommandLineOptions parse_args(int argc, char** args)
                 usage();
             }
         }
+        else if (strcmp("--sampler", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            if (strcmp("random", args[arg_index]) == 0)
+            {
+                options.fuzz.sampler = SAMPLER_RANDOM;
+            }
+            else if (strcmp("sobol", args[arg_index]) == 0)
+            {
+                options.fuzz.sampler = SAMPLER_SOBOL;
+            }
+            else if (strcmp("halton", args[arg_index]) == 0)
+            {
+                options.fuzz.sampler = SAMPLER_HALTON;
+            }
+            else if (strcmp("stratified", args[arg_index]) == 0)
+            {
+                options.fuzz.sampler = SAMPLER_STRATIFIED;
+            }
+            else
+            {
+                cout << "Unknown sampler" << endl;
+                exit(1);
+            }
+        }
         else if (strcmp("--fuzz_count", args[arg_index]) == 0)
         {
             ++arg_index;
@@ -255,6 +317,254 @@ CommandLineOptions parse_args(int argc, char** args)
                 usage();
             }
         }
+        else if (strcmp("--jobs", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* jobs_end;
+            options.jobs = strtoul(args[arg_index], &jobs_end, 10);
+            if (*jobs_end || options.jobs == 0)
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--writers", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* writers_end;
+            options.writers = strtoul(args[arg_index], &writers_end, 10);
+            if (*writers_end || options.writers == 0)
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--queue_depth", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* depth_end;
+            options.queue_depth = strtoul(args[arg_index], &depth_end, 10);
+            if (*depth_end || options.queue_depth == 0)
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--bench", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* bench_end;
+            options.bench = strtoul(args[arg_index], &bench_end, 10);
+            if (*bench_end || options.bench == 0)
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--shard", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* index_end;
+            options.shard_index = strtoul(args[arg_index], &index_end, 10);
+            if (*index_end != '/')
+            {
+                usage();
+            }
+            char* count_end;
+            options.shard_count = strtoul(index_end + 1, &count_end, 10);
+            if (*count_end || options.shard_count == 0 || options.shard_index >= options.shard_count)
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--stream", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc || args[arg_index][0] != '/')
+            {
+                usage();
+            }
+            options.stream_name = args[arg_index];
+        }
+        else if (strcmp("--stream_slots", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* slots_end;
+            options.stream_slots = strtoul(args[arg_index], &slots_end, 10);
+            if (*slots_end || options.stream_slots == 0)
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--stream_drop", args[arg_index]) == 0)
+        {
+            options.stream_drop = true;
+        }
+        else if (strcmp("--trajectory", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* frames_end;
+            options.trajectory.frames = strtoul(args[arg_index], &frames_end, 10);
+            if (*frames_end || options.trajectory.frames == 0)
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--frame_rate", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* value_end;
+            options.trajectory.frame_rate = strtof(args[arg_index], &value_end);
+            if (*value_end || !(options.trajectory.frame_rate > 0.0f))
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--inclination", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* value_end;
+            options.trajectory.inclination = strtof(args[arg_index], &value_end);
+            if (*value_end || !(options.trajectory.inclination >= 0.0f && options.trajectory.inclination <= 180.0f))
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--eccentricity", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* value_end;
+            options.trajectory.eccentricity = strtof(args[arg_index], &value_end);
+            if (*value_end || !(options.trajectory.eccentricity >= 0.0f && options.trajectory.eccentricity < 1.0f))
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--jitter", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* value_end;
+            options.trajectory.jitter = strtof(args[arg_index], &value_end);
+            if (*value_end || !(options.trajectory.jitter >= 0.0f))
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--body_rates", args[arg_index]) == 0)
+        {
+            if (arg_index + 3 >= argc)
+            {
+                usage();
+            }
+            float* rates[3] = {&options.trajectory.body_rates.x, &options.trajectory.body_rates.y, &options.trajectory.body_rates.z};
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                ++arg_index;
+                char* rate_end;
+                *rates[axis] = strtof(args[arg_index], &rate_end);
+                if (*rate_end)
+                {
+                    usage();
+                }
+            }
+        }
+        else if (strcmp("--profile", args[arg_index]) == 0)
+        {
+            options.profile = true;
+        }
+        else if (strcmp("--batch", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            char* batch_end;
+            options.batch = strtoul(args[arg_index], &batch_end, 10);
+            if (*batch_end || options.batch == 0 || options.batch > RENDER_BATCH_MAX)
+            {
+                usage();
+            }
+        }
+        else if (strcmp("--renderer", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            if (strcmp("gl", args[arg_index]) == 0)
+            {
+                options.renderer = RENDERER_GL;
+            }
+            else if (strcmp("offscreen", args[arg_index]) == 0)
+            {
+                options.renderer = RENDERER_GL_OFFSCREEN;
+            }
+            else if (strcmp("cpu", args[arg_index]) == 0)
+            {
+                options.renderer = RENDERER_CPU;
+            }
+            else
+            {
+                cout << "Unknown renderer" << endl;
+                exit(1);
+            }
+        }
+        else if (strcmp("--sensor", args[arg_index]) == 0)
+        {
+            ++arg_index;
+            if (arg_index >= argc)
+            {
+                usage();
+            }
+            options.sensor = find_sensor_profile(args[arg_index]);
+            if (!options.sensor)
+            {
+                cout << "Unknown sensor " << args[arg_index] << endl;
+                usage();
+            }
+        }
         else
         {
             usage();
@@ -263,64 +573,452 @@ CommandLineOptions parse_args(int argc, char** args)
         ++arg_index;
     }
 
+    if (options.sensor)
+    {
+        apply_sensor_profile(&options.loaded_state, *options.sensor);
+    }
+
     return options;
 }
 
-struct GeomagnetismData
+// Fuzzes and renders this shard's samples until `next_sample` reaches the
+// number of them, and
+// queues them to be written out.
+// Frames go through the capture ring, so the next samples render while the
+// previous ones are still being read back. With the offscreen renderer they
+// are drawn options.batch at a time. Samples already in `cache` (if there is
+// one) are queued straight from it without rendering.
+void export_samples(const CommandLineOptions& options, RenderState* render_state, GeomagnetismData geomag, std::atomic<unsigned int>* next_sample, OutputQueue* output, RenderCache* cache)
+{
+    FrameCapture capture;
+    capture_init(&capture, render_state, options.batch);
+
+    // Cache hits are loaded here, then swapped into an output frame
+    CapturedFrame cached_frame;
+
+    unsigned int samples = shard_samples(options);
+    unsigned int n;
+    while ((n = (*next_sample)++) < samples)
+    {
+        // Sample index in the whole fuzz run
+        unsigned int i = options.shard_index + n * options.shard_count;
+
+        SimulationState state = options.loaded_state;
+        {
+            ProfileTimer timer(STAGE_RANDOMIZE);
+            if (options.trajectory.frames)
+            {
+                trajectory_state(&state, &options.trajectory, &options.fuzz, i);
+            }
+            else
+            {
+                randomize_state(&state, &options.fuzz, i);
+            }
+        }
+        {
+            ProfileTimer timer(STAGE_COMPUTE_OUTPUTS);
+            compute_outputs(&state, geomag);
+        }
+
+        if (cache)
+        {
+            bool hit;
+            {
+                ProfileTimer timer(STAGE_CACHE_LOOKUP);
+                hit = render_cache_load(cache, state, &cached_frame);
+            }
+            if (hit)
+            {
+                CapturedFrame* frame = output_acquire(output);
+                frame->index = i;
+                frame->state = state;
+                frame->width = cached_frame.width;
+                frame->height = cached_frame.height;
+                frame->cached = true;
+                std::swap(frame->pixels, cached_frame.pixels);
+                output_push(output, frame);
+                continue;
+            }
+        }
+
+        while (capture_full(&capture))
+        {
+            CapturedFrame* frame = output_acquire(output);
+            capture_retrieve(&capture, frame);
+            output_push(output, frame);
+        }
+        capture_submit(&capture, state, i);
+    }
+
+    while (!capture_empty(&capture))
+    {
+        CapturedFrame* frame = output_acquire(output);
+        capture_retrieve(&capture, frame);
+        output_push(output, frame);
+    }
+
+    capture_cleanup(&capture);
+}
+
+void export_fuzz_run(const CommandLineOptions& options, RenderState render_state, GeomagnetismData geomag)
+{
+    unsigned int jobs = options.jobs;
+    if (jobs > 1 && render_state.renderer == RENDERER_GL)
+    {
+        // The GL context belongs to the window on this thread
+        cerr << "--jobs needs --renderer offscreen or cpu, exporting on one thread" << endl;
+        jobs = 1;
+    }
+
+    // Set by any writer thread whose export_all fails
+    std::atomic<bool> export_failed(false);
+
+    DatasetWriter dataset;
+    if (options.pack_filename)
+    {
+        if (dataset_create(&dataset, options.pack_filename, render_state.camera_width, render_state.camera_height, sizeof(SimulationState), shard_samples(options)) != 0)
+        {
+            exit(1);
+        }
+    }
+
+    ColumnsWriter columns;
+    if (options.columns_filename)
+    {
+        if (state_columns_create(&columns, options.columns_filename, shard_samples(options)) != 0)
+        {
+            exit(1);
+        }
+    }
+
+    // The ring has a single producer, the writer threads take turns. Once it
+    // times out nothing more is published, and the run fails at the end.
+    FrameRing stream;
+    std::mutex stream_mutex;
+    bool stream_failed = false;
+    if (options.stream_name)
+    {
+        if (frame_ring_create(&stream, options.stream_name, render_state.camera_width, render_state.camera_height, sizeof(SimulationState),
+                              options.stream_slots, options.stream_drop,
+                              options.shard_index, options.shard_count, shard_samples(options)) != 0)
+        {
+            exit(1);
+        }
+        cout << "Streaming to " << options.stream_name << endl;
+    }
+
+    // Checked and filled by the render threads and writers respectively
+    RenderCache cache_storage;
+    RenderCache* cache = nullptr;
+    if (options.cache_dir)
+    {
+        if (render_cache_open(&cache_storage, options.cache_dir, render_state) != 0)
+        {
+            exit(1);
+        }
+        cache = &cache_storage;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // png compression and file writes happen on the writer threads
+    OutputQueue output;
+    output.print_statistics = !options.bench;
+    output_init(&output, options.queue_depth, options.writers, [&options, &export_failed, &dataset, &columns, &stream, &stream_mutex, &stream_failed, cache](const CapturedFrame& frame)
+    {
+        // Converted frames go in a buffer per writer thread, big sensors'
+        // frames don't fit on the stack
+        thread_local std::vector<uint16_t> pixels;
+        pixels.resize(frame.pixels.size());
+
+        if (options.bench)
+        {
+            // Everything a real export does except touching the disk
+            int length = 0;
+            free(encode_image(frame, &length));
+            frame_to_lepton(frame, pixels.data());
+        }
+        // After the first failure (usually a directory that isn't there) the
+        // rest aren't tried, and the run fails at the end
+        if (options.export_filename && !export_failed
+            && !export_all(options.export_filename + std::to_string(frame.index), frame, options.raw_format))
+        {
+            export_failed = true;
+        }
+        if (options.pack_filename)
+        {
+            frame_to_lepton(frame, pixels.data());
+            // A failure is remembered by the writer and reported by dataset_finish
+            dataset_write(&dataset, frame.index / options.shard_count, frame.index, pixels.data(), &frame.state);
+        }
+        if (options.columns_filename)
+        {
+            ProfileTimer timer(STAGE_WRITE);
+            // A failure is remembered by the writer and reported by columns_finish
+            state_columns_write(&columns, frame.index / options.shard_count, frame.index, frame.state);
+        }
+        if (options.stream_name)
+        {
+            frame_to_lepton(frame, pixels.data());
+            ProfileTimer timer(STAGE_WRITE);
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            if (!stream_failed && frame_ring_publish(&stream, frame.index, pixels.data(), &frame.state, STREAM_TIMEOUT_MS) != 0)
+            {
+                cerr << "Nothing read from " << options.stream_name << " for " << STREAM_TIMEOUT_MS / 1000
+                     << " s, is a consumer running? Not streaming the rest" << endl;
+                stream_failed = true;
+            }
+        }
+        if (cache && !frame.cached)
+        {
+            ProfileTimer timer(STAGE_WRITE);
+            render_cache_store(cache, frame);
+        }
+    });
+
+    // Workers pull sample indices off a shared counter. Each sample only
+    // depends on its index, so the order they finish in doesn't matter.
+    std::atomic<unsigned int> next_sample(0);
+
+    if (jobs == 1)
+    {
+        export_samples(options, &render_state, geomag, &next_sample, &output, cache);
+    }
+    else
+    {
+        std::vector<std::thread> workers;
+        for (unsigned int j = 0; j < jobs; ++j)
+        {
+            workers.emplace_back([&]()
+            {
+                // Each worker gets its own CPU renderer or GL context
+                RenderState worker_render_state;
+                if (!render_open(&worker_render_state, render_state.renderer, render_state.camera_width, render_state.camera_height))
+                {
+                    exit(1);
+                }
+                export_samples(options, &worker_render_state, geomag, &next_sample, &output, cache);
+                render_cleanup(&worker_render_state);
+            });
+        }
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    output_finish(&output);
+
+    if (cache)
+    {
+        render_cache_report(cache);
+    }
+
+    // Everything is finished and reported before failing, so a run that
+    // couldn't write its pack still leaves its other outputs complete
+    bool failed = export_failed;
+    if (options.pack_filename && dataset_finish(&dataset) != 0)
+    {
+        failed = true;
+    }
+
+    if (options.columns_filename && columns_finish(&columns) != 0)
+    {
+        failed = true;
+    }
+
+    if (options.stream_name)
+    {
+        const FrameRingHeader* header = stream.header;
+        cout << "Streamed " << header->write_sequence << " frames to " << options.stream_name << ", "
+             << header->dropped << " dropped, waited for the consumer " << header->full_waits << " times ("
+             << header->full_wait_ns / 1e6 << " ms)" << endl;
+        frame_ring_finish(&stream);
+        if (stream_failed)
+        {
+            failed = true;
+        }
+    }
+
+    if (options.profile)
+    {
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        profile_report(cout, shard_samples(options), seconds.count());
+    }
+
+    if (failed)
+    {
+        exit(1);
+    }
+}
+
+// Number of detector runs shown in the GUI's timing graphs
+const int DETECTION_HISTORY = 120;
+
+// The GUI's host build of the detector (see detection.h). It runs on the
+// camera frame whenever the state or the detector's parameters change, rather
+// than on every frame drawn.
+struct DetectionView
 {
-    MAGtype_MagneticModel* magnetic_models[1];
-    MAGtype_Ellipsoid ellipsoid;
-    MAGtype_Geoid geoid;
+    bool enabled = true;
+    bool overlay = true;
+    bool every_frame = false;   // for steadier timings
+    int alg_choice = 0;
+    bool correct_barrel_dist = true;
+
+    bool stale = true;
+    SimulationState state;      // that the result is for
+    DetectionResult result = {};
+    float nadir_error = NAN;    // degrees, NAN without a valid result
+    unsigned int runs = 0;
+
+    // Microseconds taken by each stage and then the whole run, for the last
+    // DETECTION_HISTORY runs
+    float history[DETECTION_STAGES + 1][DETECTION_HISTORY] = {};
+    int history_next = 0;
+
+    FrameCapture capture;
+    CapturedFrame frame;
+    std::vector<uint16_t> pixels;
 };
 
-void compute_outputs(SimulationState* state, GeomagnetismData geomag)
+static bool detection_supported(const SimulationState& state)
+{
+    return state.sensor_width == DETECTION_WIDTH && state.sensor_height == DETECTION_HEIGHT;
+}
+
+// Renders the camera frame and runs the detector on it, if anything changed
+static void detection_update(DetectionView* view, const SimulationState& state)
 {
-    // calculate nadir vector
-    state->nadir = state->camera.inverse().apply_rotation(Vec3(0.0f, 0.0f, -1.0f));
-
-    // Calclate magnetic field
-    MAGtype_CoordSpherical spherical_coord;
-    MAGtype_CoordGeodetic geo_coord;
-    MAGtype_GeoMagneticElements magnetic_field;
-
-    spherical_coord.lambda = state->longitude;
-    spherical_coord.phig = state->latitude;
-    spherical_coord.r = EARTH_RADIUS + state->altitude;
-
-    MAG_SphericalToGeodetic(geomag.ellipsoid, spherical_coord, &geo_coord);
-    MAG_Geomag(geomag.ellipsoid, spherical_coord, geo_coord, geomag.magnetic_models[0], &magnetic_field);
-
-    state->magnetic_field = Vec3(magnetic_field.Y, magnetic_field.X, -magnetic_field.Z);
-    state->magnetic_field = state->camera.inverse().apply_rotation(state->magnetic_field);
-    Vec3 magnetometer = (0.001f / MAGNETIC_FIELD_SENSITIVITY) * state->magnetometer_reference_frame.inverse().apply_rotation(state->magnetic_field) + state->mag_noise;
-    // convert magnetometer to int16_t
-    state->magnetometer.x = static_cast<int16_t>(roundf(magnetometer.x));
-    state->magnetometer.y = static_cast<int16_t>(roundf(magnetometer.y));
-    state->magnetometer.z = static_cast<int16_t>(roundf(magnetometer.z));
-
-    // Convert the 3x3 rotation matrix obtained from the quaternion into a 4x4 affine transformation matrix
-    // (with zero translation).
-    // All the copying has to be done in reverse order so nothing gets overwritten
-    state->magnetometer_reference_frame.to_matrix(state->magnetometer_transformation);
-    state->magnetometer_transformation[15] = 1.0f;
-    state->magnetometer_transformation[14] = 0.0f;
-    state->magnetometer_transformation[13] = 0.0f;
-    state->magnetometer_transformation[12] = 0.0f;
-    state->magnetometer_transformation[11] = 0.0f;
-    state->magnetometer_transformation[10] = state->magnetometer_transformation[8];
-    state->magnetometer_transformation[9] = state->magnetometer_transformation[7];
-    state->magnetometer_transformation[8] = state->magnetometer_transformation[6];
-    state->magnetometer_transformation[7] = 0.0f;
-    state->magnetometer_transformation[6] = state->magnetometer_transformation[5];
-    state->magnetometer_transformation[5] = state->magnetometer_transformation[4];
-    state->magnetometer_transformation[4] = state->magnetometer_transformation[3];
-    state->magnetometer_transformation[3] = 0.0f;
-    // Rest of the values don't need to be moved
+    if (!view->enabled || !detection_supported(state))
+    {
+        return;
+    }
+    if (!view->stale && !view->every_frame && memcmp(&state, &view->state, sizeof(state)) == 0)
+    {
+        return;
+    }
+
+    capture_submit(&view->capture, state, 0);
+    capture_retrieve(&view->capture, &view->frame);
+    view->pixels.resize(view->frame.pixels.size());
+    frame_to_lepton(view->frame, view->pixels.data());
+
+    const int16_t magnetometer[3] = {state.magnetometer.x, state.magnetometer.y, state.magnetometer.z};
+    detection_run(view->pixels.data(), state.altitude, magnetometer, state.magnetometer_transformation,
+                  view->alg_choice, view->correct_barrel_dist, &view->result);
+    view->state = state;
+    view->stale = false;
+    view->runs++;
+
+    // The same comparison as run_test.tcl
+    view->nadir_error = NAN;
+    if (view->result.reject == 0)
+    {
+        float dot = state.nadir.x * view->result.nadir[0] + state.nadir.y * view->result.nadir[1] + state.nadir.z * view->result.nadir[2];
+        view->nadir_error = acosf(std::min(dot, 1.0f)) * 180.0f / M_PI;
+    }
+
+    for (unsigned int stage = 0; stage < DETECTION_STAGES; ++stage)
+    {
+        view->history[stage][view->history_next] = view->result.stage_seconds[stage] * 1e6;
+    }
+    view->history[DETECTION_STAGES][view->history_next] = view->result.seconds * 1e6;
+    view->history_next = (view->history_next + 1) % DETECTION_HISTORY;
 }
 
-void start_gui(RenderState render_state, SimulationState state, FuzzOptions fuzz_options, GeomagnetismData geomag)
+static void detection_controls(DetectionView* view, const SimulationState& state)
 {
-    SDL_ShowWindow(render_state.window);
+    view->stale |= ImGui::Checkbox("Run detector", &view->enabled);
+    ImGui::Checkbox("Overlay", &view->overlay);
+    ImGui::Checkbox("Every frame (steadier timings)", &view->every_frame);
+    view->stale |= ImGui::Combo("Fit", &view->alg_choice, "Least squares\0Chord\0");
+    view->stale |= ImGui::Checkbox("Correct barrel distortion", &view->correct_barrel_dist);
+
+    if (!detection_supported(state))
+    {
+        ImGui::TextWrapped("The detector only takes %dx%d frames", DETECTION_WIDTH, DETECTION_HEIGHT);
+        return;
+    }
+    if (view->runs == 0)
+    {
+        return;
+    }
+
+    const DetectionResult& result = view->result;
+    const char* outcome = result.reject == 0 ? "valid" : result.reject == 1 ? "not enough edge points" : "circle too small";
+    ImGui::Text("Result: %s, %u edge points", outcome, result.point_count);
+    if (result.reject != 1)
+    {
+        ImGui::Text("Circle: centre (%.1f, %.1f), radius %.1f", result.circle[0], result.circle[1], result.circle[2]);
+    }
+    ImGui::Text("Detected nadir: (%f, %f, %f)", result.nadir[0], result.nadir[1], result.nadir[2]);
+    ImGui::Text("Nadir error: %.4f degrees", view->nadir_error);
+
+    // Stage cycles are get_ccount counts, of 64 cycles each
+    int count = std::min<unsigned int>(view->runs, DETECTION_HISTORY);
+    int offset = view->runs < DETECTION_HISTORY ? 0 : view->history_next;
+    char overlay[64];
+    for (unsigned int stage = 0; stage <= DETECTION_STAGES; ++stage)
+    {
+        const char* name = stage < DETECTION_STAGES ? detection_stage_name(stage) : "total";
+        if (stage < DETECTION_STAGES)
+        {
+            snprintf(overlay, sizeof(overlay), "%u cycles, %.1f us", result.stage_cycles[stage] * 64, result.stage_seconds[stage] * 1e6);
+        }
+        else
+        {
+            snprintf(overlay, sizeof(overlay), "%.1f us, %u runs", result.seconds * 1e6, view->runs);
+        }
+        ImGui::PlotLines(name, view->history[stage], count, offset, overlay, 0.0f, FLT_MAX, ImVec2(0, 40));
+    }
+}
+
+// Draws the edge points and fitted circle over the window, which shows the
+// camera's view scaled to the window's width
+static void detection_overlay(const DetectionView& view, int window_width, int window_height)
+{
+    if (!view.enabled || !view.overlay || view.runs == 0 || !detection_supported(view.state))
+    {
+        return;
+    }
+
+    const DetectionResult& result = view.result;
+    float scale = (float)window_width / DETECTION_WIDTH;
+    auto to_window = [&](float x, float y)
+    {
+        float frame_x, frame_y;
+        detection_to_frame(&result, x, y, &frame_x, &frame_y);
+        return ImVec2(window_width * 0.5f + (frame_x - DETECTION_WIDTH * 0.5f) * scale,
+                      window_height * 0.5f + (frame_y - DETECTION_HEIGHT * 0.5f) * scale);
+    };
+
+    ImDrawList* draw_list = ImGui::GetBackgroundDrawList();
+    for (uint32_t i = 0; i < result.point_count; ++i)
+    {
+        draw_list->AddCircleFilled(to_window(result.points[2 * i], result.points[2 * i + 1]), 0.25f * scale, IM_COL32(255, 64, 64, 255));
+    }
+
+    // With too few points nothing was fitted
+    if (result.reject != 1)
+    {
+        const int segments = 720;
+        ImVec2 circle[segments];
+        for (int i = 0; i < segments; ++i)
+        {
+            float angle = 2.0f * M_PI * i / segments;
+            circle[i] = to_window(result.circle[0] + result.circle[2] * cosf(angle), result.circle[1] + result.circle[2] * sinf(angle));
+        }
+        ImU32 colour = result.reject == 0 ? IM_COL32(64, 255, 64, 255) : IM_COL32(255, 160, 0, 255);
+        draw_list->AddPolyline(circle, segments, colour, true, 2.0f);
+    }
+}
+
+void start_gui(RenderState render_state, SimulationState state, FuzzOptions fuzz_options, RawFormat raw_format, GeomagnetismData geomag)
+{
+    SDL_Window* window = (SDL_Window*)render_state.window;
+    SDL_ShowWindow(window);
 
     // Initialize ImGui
     {
@@ -329,7 +1027,7 @@ void start_gui(RenderState render_state, SimulationState state, FuzzOptions fuzz
         io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
 
         const char* glsl_version = "#version 330";
-        ImGui_ImplSDL2_InitForOpenGL(render_state.window, render_state.gl_ctxt);
+        ImGui_ImplSDL2_InitForOpenGL(window, render_state.gl_ctxt);
         ImGui_ImplOpenGL3_Init(glsl_version);
         ImGui::StyleColorsDark();
     }
@@ -338,11 +1036,17 @@ void start_gui(RenderState render_state, SimulationState state, FuzzOptions fuzz
 
     char filename_buf[256] = {};
 
+    // Each click of the Randomize button is the next sample of the fuzz run
+    unsigned int randomize_count = 0;
+
+    DetectionView detection;
+    capture_init(&detection.capture, &render_state);
+
     bool running = true;
     while (running)
     {
         ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplSDL2_NewFrame(render_state.window);
+        ImGui_ImplSDL2_NewFrame(window);
         ImGui::NewFrame();
 
         // ----------
@@ -355,7 +1059,9 @@ void start_gui(RenderState render_state, SimulationState state, FuzzOptions fuzz
                 typing |= ImGui::InputText("Filename", filename_buf, sizeof(filename_buf));
                 if (ImGui::Button("Export"))
                 {
-                    export_all(filename_buf, render_state, state);
+                    CapturedFrame frame;
+                    capture_frame(&render_state, state, &frame);
+                    export_all(filename_buf, frame, raw_format);
                 }
 
                 ImGui::TreePop();
@@ -374,7 +1080,6 @@ void start_gui(RenderState render_state, SimulationState state, FuzzOptions fuzz
                 ImGui::SliderFloat("Noise stdev", &state.noise_stdev, MIN_NOISE_STDEV, MAX_NOISE_STDEV, "%.4f", 2);
                 if (ImGui::Button("Regenerate Noise"))
                 {
-                    generate_noise(state.noise_seed, state.noise_stdev, &render_state);
                     state.noise_seed += 1;
                 }
 
@@ -430,10 +1135,10 @@ void start_gui(RenderState render_state, SimulationState state, FuzzOptions fuzz
                 ImGui::Checkbox("Noise Stdev", &fuzz_options.noise_stdev);
                 ImGui::Checkbox("Magnetometer reading", &fuzz_options.mag_reading);
                 ImGui::InputFloat("Magnetometer stdev", &fuzz_options.mag_stdev);
+                ImGui::Combo("Sampler", (int*)&fuzz_options.sampler, "Random\0Sobol\0Halton\0Stratified\0");
                 if (ImGui::Button("Randomize"))
                 {
-                    randomize_state(&state, &fuzz_options);
-                    generate_noise(state.noise_seed, state.noise_stdev, &render_state);
+                    randomize_state(&state, &fuzz_options, randomize_count++);
                 }
 
                 ImGui::TreePop();
@@ -448,22 +1153,33 @@ void start_gui(RenderState render_state, SimulationState state, FuzzOptions fuzz
 
                 ImGui::TreePop();
             }
+
+            if (ImGui::TreeNode("Detection"))
+            {
+                detection_controls(&detection, state);
+
+                ImGui::TreePop();
+            }
         }
 
         // ---------------
         // Compute Outputs
         // ---------------
         compute_outputs(&state, geomag);
+        detection_update(&detection, state);
 
         // ---------
         // Rendering
         // ---------
-        render_frame(render_state, state, SCREEN_WIDTH_PIXELS, SCREEN_HEIGHT_PIXELS);
+        int window_width, window_height;
+        SDL_GetWindowSize(window, &window_width, &window_height);
+        render_frame(render_state, state, window_width, window_height);
+        detection_overlay(detection, window_width, window_height);
 
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
-        SDL_GL_SwapWindow(render_state.window);
+        SDL_GL_SwapWindow(window);
 
         // ------
         // Events
@@ -494,50 +1210,117 @@ int main(int argc, char** args)
 {
     CommandLineOptions options = parse_args(argc, args);
 
-    // Seed fuzz engine
+    if (options.trajectory.frames)
     {
-        srand(options.fuzz.seed);
+        if (!trajectory_init(&options.trajectory, options.loaded_state))
+        {
+            cerr << "An orbit inclined at " << options.trajectory.inclination << " degrees never reaches latitude "
+                 << options.loaded_state.latitude << endl;
+            exit(1);
+        }
+        options.fuzz.count = options.trajectory.frames;
+        if (options.fuzz.sampler != SAMPLER_RANDOM)
+        {
+            cerr << "--sampler doesn't apply to --trajectory, which isn't fuzzed" << endl;
+        }
+        cout << "Trajectory of " << options.trajectory.frames << " frames at " << options.trajectory.frame_rate << " Hz ("
+             << trajectory_time(&options.trajectory, options.trajectory.frames) << " s), orbital period "
+             << 2.0 * M_PI / options.trajectory.mean_motion / 60.0 << " minutes" << endl;
+    }
 
-        // Arbitrary and possibly unnecessary scaling factor
-        options.fuzz.mag_random_engine.seed(options.fuzz.seed);
+    if (options.bench)
+    {
+        if (options.export_filename || options.pack_filename || options.columns_filename || options.stream_name || options.cache_dir)
+        {
+            cerr << "--bench doesn't write any files, ignoring --export, --pack, --columns, --stream and --cache" << endl;
+            options.export_filename = nullptr;
+            options.pack_filename = nullptr;
+            options.columns_filename = nullptr;
+            options.stream_name = nullptr;
+            options.cache_dir = nullptr;
+        }
+        options.fuzz.count = options.bench;
+        options.profile = true;
+    }
+    if (options.profile)
+    {
+        profile_enable();
     }
 
-    RenderState render_state = render_init(SCREEN_WIDTH_PIXELS, SCREEN_HEIGHT_PIXELS);
+    bool exporting = options.export_filename || options.pack_filename || options.columns_filename || options.stream_name || options.bench;
 
+    if (options.trajectory.frames && !exporting)
+    {
+        cerr << "--trajectory needs --export, --pack, --columns or --stream" << endl;
+        exit(1);
+    }
 
-    // Init geomagnetism library
-    GeomagnetismData geomag;
+    if (options.cache_dir && !exporting)
+    {
+        cerr << "--cache only applies to --export, --pack, --columns and --stream, the GUI renders every frame" << endl;
+    }
+
+    if (options.renderer != RENDERER_GL && !exporting)
     {
-        // Initialize variable for parameter to avoid warning
-        // And get a pointer to the magnetic model array
-        // (This API sucks so much)
-        char wmm_coeff_filename[] = "WMM_2020/WMM.COF";
-        MAGtype_MagneticModel** magnetic_models_ptr = geomag.magnetic_models;
-        if(!MAG_robustReadMagModels(wmm_coeff_filename, &magnetic_models_ptr, 1))
+        cerr << "The GUI needs the gl renderer, use other renderers together with --export, --pack, --columns or --stream" << endl;
+        exit(1);
+    }
+
+    const SimulationState& sensor = options.loaded_state;
+    RenderState render_state;
+    if (options.renderer == RENDERER_GL)
+    {
+        if (!window_init(&render_state, std::max(SCREEN_WIDTH_PIXELS, sensor.sensor_width), std::max(SCREEN_HEIGHT_PIXELS, sensor.sensor_height),
+                         sensor.sensor_width, sensor.sensor_height))
         {
-            std::cerr << "Magnetic field coefficients file WMM_2020/WMM.COF not found." << std::endl;
+            exit(1);
         }
-        MAG_SetDefaults(&geomag.ellipsoid, &geomag.geoid);
     }
-
-    // If export filename is given then don't run GUI
-    if (options.export_filename)
+    else if (!render_open(&render_state, options.renderer, sensor.sensor_width, sensor.sensor_height))
     {
-        std::string base_filename(options.export_filename);
-        for (unsigned int i = 0; i < options.fuzz.count; ++i)
+        exit(1);
+    }
+    if (exporting)
+    {
+        cout << "Sensor " << sensor.sensor_name << ", " << sensor.sensor_width << "x" << sensor.sensor_height << " at "
+             << sensor.horizontal_fov << " degrees, " << sensor.bit_depth << "-bit" << endl;
+        if (options.export_filename && options.raw_format == RAW_PACKED14 && sensor.bit_depth > 14)
         {
-            randomize_state(&options.loaded_state, &options.fuzz);
-            generate_noise(options.loaded_state.noise_seed, options.loaded_state.noise_stdev, &render_state);
-            compute_outputs(&options.loaded_state, geomag);
-            export_all(base_filename + std::to_string(i), render_state, options.loaded_state);
+            cerr << "Frames from " << sensor.sensor_name << " don't fit in 14 bits, exporting .bin files instead of .b14" << endl;
         }
     }
+
+
+    GeomagnetismData geomag;
+    if (!geomag_init(&geomag, options.geomag_grid_filename))
+    {
+        exit(1);
+    }
+    if (geomag.grid.data)
+    {
+        cout << "Using geomagnetic grid " << options.geomag_grid_filename << ", worst-case interpolation error "
+             << geomag.grid.header->max_error << " nT" << endl;
+    }
+
+    // If export filename is given then don't run GUI
+    if (exporting)
+    {
+        export_fuzz_run(options, render_state, geomag);
+    }
     else
     {
-        start_gui(render_state, options.loaded_state, options.fuzz, geomag);
+        start_gui(render_state, options.loaded_state, options.fuzz, options.raw_format, geomag);
     }
 
-    SDL_Quit();
+    if (options.renderer == RENDERER_GL)
+    {
+        window_cleanup(&render_state);
+    }
+    else
+    {
+        render_cleanup(&render_state);
+    }
+    geomag_cleanup(&geomag);
 
     return 0;
 }
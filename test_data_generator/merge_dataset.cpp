@@ -0,0 +1,110 @@
+// Merges .hrzpack datasets made by --shard k/N runs (see dataset.h) into one,
+// ordered by sample index.
+//
+// Usage: ./merge_dataset <output.hrzpack> <shard.hrzpack>...
+//
+// Every sample of a sharded run only depends on the fuzz seed and its index,
+// so merging all N shards gives a file byte-identical to running the whole
+// fuzz run in one process. The shards have to cover every index from 0 up to
+// the highest one exactly once, otherwise nothing is written.
+
+#include "dataset.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+struct Sample
+{
+    uint64_t index;
+    const DatasetReader* reader;
+    uint64_t slot;
+};
+
+int main(int argc, char** args)
+{
+    if (argc < 3)
+    {
+        cout << "Usage: ./merge_dataset <output.hrzpack> <shard.hrzpack>..." << endl;
+        return 1;
+    }
+
+    std::vector<DatasetReader> readers(argc - 2);
+    for (int i = 2; i < argc; ++i)
+    {
+        DatasetReader* reader = &readers[i - 2];
+        if (dataset_open(reader, args[i]) != 0)
+        {
+            return 1;
+        }
+
+        const DatasetHeader* first = readers[0].header;
+        const DatasetHeader* header = reader->header;
+        if (header->frame_width != first->frame_width || header->frame_height != first->frame_height
+            || header->state_size != first->state_size)
+        {
+            cerr << args[i] << " has different frame or state sizes from " << args[2] << endl;
+            return 1;
+        }
+    }
+
+    std::vector<Sample> samples;
+    for (const DatasetReader& reader : readers)
+    {
+        for (uint64_t slot = 0; slot < dataset_count(&reader); ++slot)
+        {
+            samples.push_back({dataset_sample_index(&reader, slot), &reader, slot});
+        }
+    }
+
+    std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b)
+    {
+        return a.index < b.index;
+    });
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        if (samples[i].index < i)
+        {
+            cerr << "Sample " << samples[i].index << " is in more than one shard" << endl;
+            return 1;
+        }
+        if (samples[i].index > i)
+        {
+            cerr << "Sample " << i << " isn't in any shard, is one missing?" << endl;
+            return 1;
+        }
+    }
+
+    const DatasetHeader* header = readers[0].header;
+    DatasetWriter writer;
+    if (dataset_create(&writer, args[1], header->frame_width, header->frame_height, header->state_size, samples.size()) != 0)
+    {
+        return 1;
+    }
+
+    for (size_t slot = 0; slot < samples.size(); ++slot)
+    {
+        const Sample& sample = samples[slot];
+        if (dataset_write(&writer, slot, sample.index, dataset_frame(sample.reader, sample.slot), dataset_state(sample.reader, sample.slot)) != 0)
+        {
+            return 1;
+        }
+    }
+
+    if (dataset_finish(&writer) != 0)
+    {
+        return 1;
+    }
+
+    for (DatasetReader& reader : readers)
+    {
+        dataset_close(&reader);
+    }
+
+    cout << "Merged " << samples.size() << " samples from " << readers.size() << " shards into " << args[1] << endl;
+    return 0;
+}
@@ -0,0 +1,318 @@
+#include "noise.h"
+
+#include <cmath>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Philox4x32 constants (Salmon et al., "Parallel random numbers: as easy as
+// 1, 2, 3")
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+static const int PHILOX_ROUNDS = 10;
+
+// Uniforms are odd multiples of 2^-24, so never 0 or 1
+static const float UNIFORM_SCALE = 1.0f / 16777216.0f;
+
+// Angles are odd multiples of 2^-23 * pi/2, in (-pi/4, pi/4)
+static const float ANGLE_SCALE = 1.5707963267948966f / 8388608.0f;
+
+static const float SQRT_HALF = 0.707106781186547524f;
+static const float LN2_HI = 0.693359375f;
+static const float LN2_LO = -2.12194440e-4f;
+
+// Cephes logf polynomial, for mantissas in [sqrt(1/2) - 1, sqrt(2) - 1)
+static const float LOG_P0 = 7.0376836292e-2f;
+static const float LOG_P1 = -1.1514610310e-1f;
+static const float LOG_P2 = 1.1676998740e-1f;
+static const float LOG_P3 = -1.2420140846e-1f;
+static const float LOG_P4 = 1.4249322787e-1f;
+static const float LOG_P5 = -1.6668057665e-1f;
+static const float LOG_P6 = 2.0000714765e-1f;
+static const float LOG_P7 = -2.4999993993e-1f;
+static const float LOG_P8 = 3.3333331174e-1f;
+
+// Cephes sinf/cosf polynomials, for angles in [-pi/4, pi/4]
+static const float SIN_P0 = -1.9515295891e-4f;
+static const float SIN_P1 = 8.3321608736e-3f;
+static const float SIN_P2 = -1.6666654611e-1f;
+static const float COS_P0 = 2.443315711809948e-5f;
+static const float COS_P1 = -1.388731625493765e-3f;
+static const float COS_P2 = 4.166664568298827e-2f;
+
+// Both paths below evaluate exactly the same float operations in the same
+// order, so they agree to the bit. Apart from sqrt, which is correctly rounded
+// everywhere, don't use libm in either of them.
+
+static inline void philox(uint32_t block, uint32_t seed, uint32_t out[4])
+{
+    uint32_t c0 = block, c1 = 0, c2 = 0, c3 = 0;
+    uint32_t k0 = seed, k1 = 0;
+    for (int round = 0; round < PHILOX_ROUNDS; ++round)
+    {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c0 = n0;
+        c1 = (uint32_t)p1;
+        c2 = n2;
+        c3 = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// sqrt(-2 ln u) * stdev, with u taken from the top 24 bits of `bits`
+static inline float box_muller_radius(uint32_t bits, float stdev)
+{
+    float u = (float)(int32_t)((bits >> 8) | 1) * UNIFORM_SCALE;
+
+    // Split u into a mantissa in [0.5, 1) and an exponent
+    uint32_t u_bits;
+    memcpy(&u_bits, &u, sizeof(u_bits));
+    float e = (float)((int32_t)(u_bits >> 23) - 126);
+    u_bits = (u_bits & 0x807FFFFF) | 0x3F000000;
+    float m;
+    memcpy(&m, &u_bits, sizeof(m));
+
+    if (m < SQRT_HALF)
+    {
+        e = e - 1.0f;
+        m = m + m;
+    }
+    m = m - 1.0f;
+
+    float z = m * m;
+    float y = LOG_P0;
+    y = y * m + LOG_P1;
+    y = y * m + LOG_P2;
+    y = y * m + LOG_P3;
+    y = y * m + LOG_P4;
+    y = y * m + LOG_P5;
+    y = y * m + LOG_P6;
+    y = y * m + LOG_P7;
+    y = y * m + LOG_P8;
+    y = y * m * z;
+    y = y + e * LN2_LO;
+    y = y - 0.5f * z;
+    float log_u = m + y;
+    log_u = log_u + e * LN2_HI;
+
+    return sqrtf(-2.0f * log_u) * stdev;
+}
+
+// cos and sin of a uniform angle taken from `bits`. The top two bits pick a
+// quadrant and the next 22 an angle within it, so no range reduction is needed.
+static inline void box_muller_angle(uint32_t bits, float* cos_out, float* sin_out)
+{
+    int32_t fraction = (int32_t)((bits >> 8) & 0x3FFFFF);
+    float a = (float)(2 * fraction - 0x3FFFFF) * ANGLE_SCALE;
+    float z = a * a;
+
+    float s = SIN_P0;
+    s = s * z + SIN_P1;
+    s = s * z + SIN_P2;
+    s = s * z * a + a;
+
+    float c = COS_P0;
+    c = c * z + COS_P1;
+    c = c * z + COS_P2;
+    c = c * z * z - 0.5f * z + 1.0f;
+
+    switch (bits >> 30)
+    {
+        case 0: *cos_out = c;  *sin_out = s;  break;
+        case 1: *cos_out = -s; *sin_out = c;  break;
+        case 2: *cos_out = -c; *sin_out = -s; break;
+        case 3: *cos_out = s;  *sin_out = -c; break;
+    }
+}
+
+static inline void noise_block(uint32_t seed, float stdev, uint32_t block, float out[4])
+{
+    uint32_t bits[4];
+    philox(block, seed, bits);
+
+    float r0 = box_muller_radius(bits[0], stdev);
+    float r1 = box_muller_radius(bits[2], stdev);
+    float c0, s0, c1, s1;
+    box_muller_angle(bits[1], &c0, &s0);
+    box_muller_angle(bits[3], &c1, &s1);
+
+    out[0] = r0 * c0;
+    out[1] = r0 * s0;
+    out[2] = r1 * c1;
+    out[3] = r1 * s1;
+}
+
+#ifdef __SSE2__
+// Low and high halves of the 32x32 bit products of each lane of `a` with `m`
+static inline void mulhilo(__m128i a, __m128i m, __m128i* hi, __m128i* lo)
+{
+    __m128i even = _mm_mul_epu32(a, m);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    *lo = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    *hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 3, 1)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 3, 1)));
+}
+
+static inline __m128 box_muller_radius4(__m128i bits, __m128 stdev)
+{
+    __m128i u_int = _mm_or_si128(_mm_srli_epi32(bits, 8), _mm_set1_epi32(1));
+    __m128 u = _mm_mul_ps(_mm_cvtepi32_ps(u_int), _mm_set1_ps(UNIFORM_SCALE));
+
+    __m128i u_bits = _mm_castps_si128(u);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(u_bits, 23), _mm_set1_epi32(126)));
+    u_bits = _mm_or_si128(_mm_and_si128(u_bits, _mm_set1_epi32(0x807FFFFF)), _mm_set1_epi32(0x3F000000));
+    __m128 m = _mm_castsi128_ps(u_bits);
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(SQRT_HALF));
+    e = _mm_sub_ps(e, _mm_and_ps(small, one));
+    m = _mm_add_ps(m, _mm_and_ps(small, m));
+    m = _mm_sub_ps(m, one);
+
+    __m128 z = _mm_mul_ps(m, m);
+    __m128 y = _mm_set1_ps(LOG_P0);
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P1));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P2));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P3));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P4));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P5));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P6));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P7));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P8));
+    y = _mm_mul_ps(_mm_mul_ps(y, m), z);
+    y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(LN2_LO)));
+    y = _mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+    __m128 log_u = _mm_add_ps(m, y);
+    log_u = _mm_add_ps(log_u, _mm_mul_ps(e, _mm_set1_ps(LN2_HI)));
+
+    return _mm_mul_ps(_mm_sqrt_ps(_mm_mul_ps(_mm_set1_ps(-2.0f), log_u)), stdev);
+}
+
+static inline void box_muller_angle4(__m128i bits, __m128* cos_out, __m128* sin_out)
+{
+    __m128i fraction = _mm_and_si128(_mm_srli_epi32(bits, 8), _mm_set1_epi32(0x3FFFFF));
+    fraction = _mm_sub_epi32(_mm_add_epi32(fraction, fraction), _mm_set1_epi32(0x3FFFFF));
+    __m128 a = _mm_mul_ps(_mm_cvtepi32_ps(fraction), _mm_set1_ps(ANGLE_SCALE));
+    __m128 z = _mm_mul_ps(a, a);
+
+    __m128 s = _mm_set1_ps(SIN_P0);
+    s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(SIN_P1));
+    s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(SIN_P2));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), a), a);
+
+    __m128 c = _mm_set1_ps(COS_P0);
+    c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(COS_P1));
+    c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(COS_P2));
+    c = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+
+    // Same quadrant table as the scalar switch: odd quadrants swap sin and
+    // cos, then the signs follow the quadrant
+    __m128i quadrant = _mm_srli_epi32(bits, 30);
+    __m128 swap = _mm_castsi128_ps(_mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(quadrant, _mm_set1_epi32(1))));
+    __m128 cos_a = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+    __m128 sin_a = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+
+    __m128i negate_sin = _mm_slli_epi32(_mm_srli_epi32(quadrant, 1), 31);
+    __m128i negate_cos = _mm_slli_epi32(_mm_xor_si128(quadrant, _mm_srli_epi32(quadrant, 1)), 31);
+    *cos_out = _mm_xor_ps(cos_a, _mm_castsi128_ps(negate_cos));
+    *sin_out = _mm_xor_ps(sin_a, _mm_castsi128_ps(negate_sin));
+}
+
+// Four blocks (16 elements) starting at `block`, one block per lane
+static inline void noise_block4(uint32_t seed, __m128 stdev, uint32_t block, float* out)
+{
+    __m128i c0 = _mm_add_epi32(_mm_set1_epi32(block), _mm_setr_epi32(0, 1, 2, 3));
+    __m128i c1 = _mm_setzero_si128();
+    __m128i c2 = _mm_setzero_si128();
+    __m128i c3 = _mm_setzero_si128();
+    __m128i k0 = _mm_set1_epi32(seed);
+    __m128i k1 = _mm_setzero_si128();
+
+    const __m128i m0 = _mm_set1_epi32(PHILOX_M0);
+    const __m128i m1 = _mm_set1_epi32(PHILOX_M1);
+    const __m128i w0 = _mm_set1_epi32(PHILOX_W0);
+    const __m128i w1 = _mm_set1_epi32(PHILOX_W1);
+
+    for (int round = 0; round < PHILOX_ROUNDS; ++round)
+    {
+        __m128i hi0, lo0, hi1, lo1;
+        mulhilo(c0, m0, &hi0, &lo0);
+        mulhilo(c2, m1, &hi1, &lo1);
+        c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), k0);
+        c1 = lo1;
+        c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), k1);
+        c3 = lo0;
+        k0 = _mm_add_epi32(k0, w0);
+        k1 = _mm_add_epi32(k1, w1);
+    }
+
+    __m128 r0 = box_muller_radius4(c0, stdev);
+    __m128 r1 = box_muller_radius4(c2, stdev);
+    __m128 cos0, sin0, cos1, sin1;
+    box_muller_angle4(c1, &cos0, &sin0);
+    box_muller_angle4(c3, &cos1, &sin1);
+
+    // Each lane holds one block, so transpose to get each block's four
+    // elements next to each other
+    __m128 row0 = _mm_mul_ps(r0, cos0);
+    __m128 row1 = _mm_mul_ps(r0, sin0);
+    __m128 row2 = _mm_mul_ps(r1, cos1);
+    __m128 row3 = _mm_mul_ps(r1, sin1);
+    _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+    _mm_storeu_ps(out, row0);
+    _mm_storeu_ps(out + 4, row1);
+    _mm_storeu_ps(out + 8, row2);
+    _mm_storeu_ps(out + 12, row3);
+}
+#endif
+
+void noise_fill(uint32_t seed, float stdev, float* out, uint32_t first, uint32_t count)
+{
+    uint32_t i = first;
+    uint32_t end = first + count;
+    float block_values[4];
+
+    // Partial block at the start
+    if (i % 4 != 0 && i < end)
+    {
+        noise_block(seed, stdev, i / 4, block_values);
+        for (; i % 4 != 0 && i < end; ++i)
+        {
+            *out++ = block_values[i % 4];
+        }
+    }
+
+#ifdef __SSE2__
+    const __m128 stdev4 = _mm_set1_ps(stdev);
+    for (; i + 16 <= end; i += 16, out += 16)
+    {
+        noise_block4(seed, stdev4, i / 4, out);
+    }
+#endif
+
+    for (; i + 4 <= end; i += 4, out += 4)
+    {
+        noise_block(seed, stdev, i / 4, out);
+    }
+
+    // Partial block at the end
+    if (i < end)
+    {
+        noise_block(seed, stdev, i / 4, block_values);
+        for (; i < end; ++i)
+        {
+            *out++ = block_values[i % 4];
+        }
+    }
+}
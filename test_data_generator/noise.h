@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+// Gaussian sensor noise from a counter-based generator.
+//
+// Element i of the noise field (row-major, so i = y * width + x) depends only
+// on the seed and i: it comes from block i / 4 of Philox4x32-10 keyed by the
+// seed, turned into normals with Box-Muller. There's no generator state to
+// carry between calls, so any row or tile of a frame can be generated on its
+// own, from any thread, and comes out the same as when the whole frame is
+// generated at once. The SSE2 and scalar paths produce identical bits.
+
+// Writes elements [first, first + count) of the noise field for `seed` to
+// `out`, scaled to standard deviation `stdev`.
+void noise_fill(uint32_t seed, float stdev, float* out, uint32_t first, uint32_t count);
@@ -0,0 +1,131 @@
+// Times sensor noise generation for one frame.
+//
+// Usage: ./noise_bench [frames] [threads]
+//
+// Compares the old std::normal_distribution loop with noise_fill over the
+// whole frame, and with noise_fill split into rows across threads. Also checks
+// that generating the frame in pieces gives the same bits as all at once.
+
+#include "noise.h"
+#include "sim.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const uint32_t FRAME_SIZE = LEPTON_WIDTH * LEPTON_HEIGHT;
+static const float STDEV = 0.01f;
+
+// What generate_noise used to do
+static void std_noise(uint32_t seed, float stdev, float* out)
+{
+    std::default_random_engine random_engine(seed);
+    std::normal_distribution<float> normal_dist(0.0f, stdev);
+    for (size_t i = 0; i < FRAME_SIZE; ++i)
+    {
+        out[i] = normal_dist(random_engine);
+    }
+}
+
+static void threaded_noise(uint32_t seed, float stdev, float* out, unsigned int thread_count)
+{
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < thread_count; ++t)
+    {
+        uint32_t first_row = LEPTON_HEIGHT * t / thread_count;
+        uint32_t end_row = LEPTON_HEIGHT * (t + 1) / thread_count;
+        threads.emplace_back([=]()
+        {
+            uint32_t first = first_row * LEPTON_WIDTH;
+            noise_fill(seed, stdev, out + first, first, (end_row - first_row) * LEPTON_WIDTH);
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+template<typename F>
+static double ns_per_frame(unsigned int frames, F generate)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int frame = 0; frame < frames; ++frame)
+    {
+        generate(frame);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / frames;
+}
+
+int main(int argc, char** args)
+{
+    unsigned int frames = argc > 1 ? atoi(args[1]) : 2000;
+    unsigned int thread_count = argc > 2 ? atoi(args[2]) : std::thread::hardware_concurrency();
+    if (frames == 0 || thread_count == 0)
+    {
+        cout << "Usage: ./noise_bench [frames] [threads]" << endl;
+        return 1;
+    }
+
+    std::vector<float> whole(FRAME_SIZE);
+    std::vector<float> pieces(FRAME_SIZE);
+
+    // Reproducibility: odd sized pieces that start and end mid-block
+    for (uint32_t seed = 0; seed < 16; ++seed)
+    {
+        noise_fill(seed, STDEV, whole.data(), 0, FRAME_SIZE);
+        for (uint32_t first = 0, size = 1; first < FRAME_SIZE; first += size, size = size % 37 + 3)
+        {
+            uint32_t count = std::min(size, FRAME_SIZE - first);
+            noise_fill(seed, STDEV, pieces.data() + first, first, count);
+        }
+        if (memcmp(whole.data(), pieces.data(), FRAME_SIZE * sizeof(float)) != 0)
+        {
+            cerr << "Noise for seed " << seed << " depends on how the frame is split" << endl;
+            return 1;
+        }
+    }
+
+    // Sanity check on the distribution over a few frames
+    double sum = 0.0, sum_sq = 0.0;
+    for (uint32_t seed = 0; seed < 16; ++seed)
+    {
+        noise_fill(seed, 1.0f, whole.data(), 0, FRAME_SIZE);
+        for (float value : whole)
+        {
+            sum += value;
+            sum_sq += (double)value * value;
+        }
+    }
+    double n = 16.0 * FRAME_SIZE;
+    cout << "noise_fill with stdev 1: mean " << sum / n << ", stdev " << sqrt(sum_sq / n - (sum / n) * (sum / n)) << endl;
+
+    double std_ns = ns_per_frame(frames, [&](unsigned int frame)
+    {
+        std_noise(frame, STDEV, whole.data());
+    });
+    double fill_ns = ns_per_frame(frames, [&](unsigned int frame)
+    {
+        noise_fill(frame, STDEV, whole.data(), 0, FRAME_SIZE);
+    });
+    double threaded_ns = ns_per_frame(frames, [&](unsigned int frame)
+    {
+        threaded_noise(frame, STDEV, whole.data(), thread_count);
+    });
+
+    cout << LEPTON_WIDTH << "x" << LEPTON_HEIGHT << " frame, " << frames << " frames" << endl;
+    cout << "std::normal_distribution:      " << std_ns / 1000.0 << " us/frame" << endl;
+    cout << "noise_fill:                    " << fill_ns / 1000.0 << " us/frame (" << std_ns / fill_ns << "x)" << endl;
+    cout << "noise_fill on " << thread_count << " threads by row: " << threaded_ns / 1000.0 << " us/frame (" << std_ns / threaded_ns << "x)" << endl;
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "output_queue.h"
+#include "profiler.h"
+
+#include <chrono>
+#include <iostream>
+
+using std::cout;
+using std::endl;
+
+static void writer_loop(OutputQueue* output)
+{
+    std::unique_lock<std::mutex> lock(output->mutex);
+    while (true)
+    {
+        output->frame_queued.wait(lock, [output]() { return output->closed || !output->queued.empty(); });
+        if (output->queued.empty())
+        {
+            // closed and nothing left
+            return;
+        }
+
+        CapturedFrame* frame = output->queued.front();
+        output->queued.pop_front();
+        ++output->writing;
+
+        lock.unlock();
+        output->write(*frame);
+        lock.lock();
+
+        --output->writing;
+        ++output->frames_written;
+        output->free_frames.push_back(frame);
+        output->frame_freed.notify_one();
+    }
+}
+
+void output_init(OutputQueue* output, unsigned int capacity, unsigned int writer_count, FrameWriter write)
+{
+    output->write = write;
+    output->capacity = capacity;
+
+    for (unsigned int i = 0; i < capacity; ++i)
+    {
+        CapturedFrame* frame = new CapturedFrame;
+        output->frames.push_back(frame);
+        output->free_frames.push_back(frame);
+    }
+
+    for (unsigned int i = 0; i < writer_count; ++i)
+    {
+        output->writers.emplace_back(writer_loop, output);
+    }
+}
+
+CapturedFrame* output_acquire(OutputQueue* output)
+{
+    ProfileTimer timer(STAGE_OUTPUT_WAIT);
+
+    std::unique_lock<std::mutex> lock(output->mutex);
+    if (output->free_frames.empty())
+    {
+        // Backpressure: the writers can't keep up
+        auto wait_start = std::chrono::steady_clock::now();
+        output->frame_freed.wait(lock, [output]() { return !output->free_frames.empty(); });
+        std::chrono::duration<double> waited = std::chrono::steady_clock::now() - wait_start;
+
+        ++output->full_waits;
+        output->full_wait_seconds += waited.count();
+    }
+
+    CapturedFrame* frame = output->free_frames.back();
+    output->free_frames.pop_back();
+    return frame;
+}
+
+void output_push(OutputQueue* output, CapturedFrame* frame)
+{
+    std::lock_guard<std::mutex> lock(output->mutex);
+    output->queued.push_back(frame);
+
+    unsigned int depth = output->queued.size();
+    output->queued_depth_sum += depth;
+    output->writing_depth_sum += output->writing;
+    if (depth > output->max_queued_depth)
+    {
+        output->max_queued_depth = depth;
+    }
+
+    output->frame_queued.notify_one();
+}
+
+void output_finish(OutputQueue* output)
+{
+    {
+        std::lock_guard<std::mutex> lock(output->mutex);
+        output->closed = true;
+    }
+    output->frame_queued.notify_all();
+
+    unsigned int writer_count = output->writers.size();
+    for (std::thread& writer : output->writers)
+    {
+        writer.join();
+    }
+    output->writers.clear();
+
+    for (CapturedFrame* frame : output->frames)
+    {
+        delete frame;
+    }
+    output->frames.clear();
+    output->free_frames.clear();
+
+    if (output->frames_written && output->print_statistics)
+    {
+        double pushes = (double)output->frames_written;
+        cout << "Output queue: " << output->frames_written << " frames, "
+             << "queued depth mean " << output->queued_depth_sum / pushes
+             << " max " << output->max_queued_depth
+             << " of " << output->capacity << ", "
+             << "writing depth mean " << output->writing_depth_sum / pushes
+             << " of " << writer_count << ", "
+             << "render threads waited on a full queue " << output->full_waits
+             << " times (" << output->full_wait_seconds << " s)" << endl;
+    }
+}
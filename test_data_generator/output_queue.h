@@ -0,0 +1,59 @@
+#pragma once
+
+#include "capture.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Writes one frame out, e.g. as png + bin + hrz files
+typedef std::function<void(const CapturedFrame&)> FrameWriter;
+
+// Bounded queue between the render threads and a pool of writer threads that
+// do the png compression and file I/O.
+//
+// Render threads take an empty frame with output_acquire, fill it and hand it
+// over with output_push. There are only `capacity` frames, so output_acquire
+// blocks once they're all queued or being written. That is the only time
+// rendering waits on the disk.
+struct OutputQueue
+{
+    FrameWriter write;
+    unsigned int capacity = 0;
+
+    std::mutex mutex;
+    std::condition_variable frame_queued;
+    std::condition_variable frame_freed;
+
+    std::vector<CapturedFrame*> frames;     // owns all of them
+    std::vector<CapturedFrame*> free_frames;
+    std::deque<CapturedFrame*> queued;
+    unsigned int writing = 0;
+    bool closed = false;
+
+    std::vector<std::thread> writers;
+
+    // Statistics, reported by output_finish
+    unsigned long long frames_written = 0;
+    unsigned long long queued_depth_sum = 0;   // sampled on every push
+    unsigned long long writing_depth_sum = 0;
+    unsigned int max_queued_depth = 0;
+    unsigned long long full_waits = 0;
+    double full_wait_seconds = 0.0;
+    bool print_statistics = true;
+};
+
+void output_init(OutputQueue* output, unsigned int capacity, unsigned int writer_count, FrameWriter write);
+
+// Returns an unused frame, waiting for a writer to finish one if they're all taken
+CapturedFrame* output_acquire(OutputQueue* output);
+
+// Queues a frame from output_acquire to be written
+void output_push(OutputQueue* output, CapturedFrame* frame);
+
+// Waits for everything queued to be written, stops the writers and prints
+// how deep each stage of the queue got
+void output_finish(OutputQueue* output);
@@ -0,0 +1,104 @@
+#include "outputs.h"
+#include "wmm_embedded.h"
+
+#include <cmath>
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+
+bool geomag_init(GeomagnetismData* geomag, const char* grid_filename)
+{
+    // The coefficients are compiled in, see wmm_embedded.h
+    geomag->magnetic_models[0] = wmm_embedded_model();
+    if (!geomag->magnetic_models[0])
+    {
+        cerr << "Couldn't allocate the magnetic field model" << endl;
+        return false;
+    }
+    MAG_SetDefaults(&geomag->ellipsoid, &geomag->geoid);
+
+    // Coefficients at the model epoch, without secular variation
+    if (!geomag_batch_init(&geomag->batch, geomag->magnetic_models[0], geomag->ellipsoid, geomag->magnetic_models[0]->epoch))
+    {
+        cerr << "Magnetic field model is of too high a degree" << endl;
+        geomag_cleanup(geomag);
+        return false;
+    }
+
+    if (grid_filename)
+    {
+        if (geomag_grid_open(&geomag->grid, grid_filename) != 0)
+        {
+            geomag_cleanup(geomag);
+            return false;
+        }
+        if (geomag->grid.header->model_year != geomag->magnetic_models[0]->epoch)
+        {
+            cerr << grid_filename << " was built for a different model epoch" << endl;
+            geomag_cleanup(geomag);
+            return false;
+        }
+    }
+    return true;
+}
+
+void geomag_cleanup(GeomagnetismData* geomag)
+{
+    geomag_grid_close(&geomag->grid);
+    if (geomag->magnetic_models[0])
+    {
+        MAG_FreeMagneticModelMemory(geomag->magnetic_models[0]);
+        geomag->magnetic_models[0] = nullptr;
+    }
+}
+
+void compute_outputs(SimulationState* state, const GeomagnetismData& geomag)
+{
+    // calculate nadir vector
+    state->nadir = state->camera.inverse().apply_rotation(Vec3(0.0f, 0.0f, -1.0f));
+
+    // Calclate magnetic field
+    double latitude = state->latitude;
+    double longitude = state->longitude;
+    double radius = EARTH_RADIUS + state->altitude;
+    double north, east, down;
+    float grid_field[3];
+    if (geomag.grid.data && geomag_grid_lookup(&geomag.grid, state->latitude, state->longitude, state->altitude, grid_field) == 0)
+    {
+        north = grid_field[0];
+        east = grid_field[1];
+        down = grid_field[2];
+    }
+    else
+    {
+        geomag_batch_evaluate(&geomag.batch, 1, &latitude, &longitude, &radius, &north, &east, &down);
+    }
+
+    state->magnetic_field = Vec3(east, north, -down);
+    state->magnetic_field = state->camera.inverse().apply_rotation(state->magnetic_field);
+    Vec3 magnetometer = (0.001f / MAGNETIC_FIELD_SENSITIVITY) * state->magnetometer_reference_frame.inverse().apply_rotation(state->magnetic_field) + state->mag_noise;
+    // convert magnetometer to int16_t
+    state->magnetometer.x = static_cast<int16_t>(roundf(magnetometer.x));
+    state->magnetometer.y = static_cast<int16_t>(roundf(magnetometer.y));
+    state->magnetometer.z = static_cast<int16_t>(roundf(magnetometer.z));
+
+    // Convert the 3x3 rotation matrix obtained from the quaternion into a 4x4 affine transformation matrix
+    // (with zero translation).
+    // All the copying has to be done in reverse order so nothing gets overwritten
+    state->magnetometer_reference_frame.to_matrix(state->magnetometer_transformation);
+    state->magnetometer_transformation[15] = 1.0f;
+    state->magnetometer_transformation[14] = 0.0f;
+    state->magnetometer_transformation[13] = 0.0f;
+    state->magnetometer_transformation[12] = 0.0f;
+    state->magnetometer_transformation[11] = 0.0f;
+    state->magnetometer_transformation[10] = state->magnetometer_transformation[8];
+    state->magnetometer_transformation[9] = state->magnetometer_transformation[7];
+    state->magnetometer_transformation[8] = state->magnetometer_transformation[6];
+    state->magnetometer_transformation[7] = 0.0f;
+    state->magnetometer_transformation[6] = state->magnetometer_transformation[5];
+    state->magnetometer_transformation[5] = state->magnetometer_transformation[4];
+    state->magnetometer_transformation[4] = state->magnetometer_transformation[3];
+    state->magnetometer_transformation[3] = 0.0f;
+    // Rest of the values don't need to be moved
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "geomag_batch.h"
+#include "geomag_grid.h"
+#include "sim.h"
+
+// Ground truth: the nadir vector and magnetometer reading that go with a
+// state's inputs
+
+struct GeomagnetismData
+{
+    MAGtype_MagneticModel* magnetic_models[1] = {};
+    MAGtype_Ellipsoid ellipsoid;
+    MAGtype_Geoid geoid;
+
+    // The model above, ready for geomag_batch_evaluate
+    GeomagBatchModel batch;
+
+    // Used instead of the model when loaded with --geomag_grid. Points outside
+    // it still go to the model.
+    GeomagGrid grid = {};
+};
+
+// Loads the compiled in WMM model, and the grid made by build_geomag_grid
+// from `grid_filename` if it isn't NULL. Returns false, having printed why, if
+// either can't be used.
+bool geomag_init(GeomagnetismData* geomag, const char* grid_filename);
+void geomag_cleanup(GeomagnetismData* geomag);
+
+// Fills in the state's outputs (nadir, magnetic_field, magnetometer and
+// magnetometer_transformation) from its inputs
+void compute_outputs(SimulationState* state, const GeomagnetismData& geomag);
@@ -0,0 +1,97 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+bool profile_enabled = false;
+
+static const char* stage_names[PROFILE_STAGE_COUNT] =
+{
+    "randomize_state",
+    "compute_outputs",
+    "cache_lookup",
+    "render",
+    "readback",
+    "output_wait",
+    "encode_png",
+    "convert",
+    "write",
+};
+
+struct ProfileBuffer
+{
+    std::vector<uint64_t> durations[PROFILE_STAGE_COUNT];
+};
+
+// Every thread's buffer. They're kept after the threads exit so the report
+// can be made once all the workers have been joined.
+static std::mutex buffers_mutex;
+static std::vector<ProfileBuffer*> buffers;
+
+void profile_enable()
+{
+    profile_enabled = true;
+}
+
+void profile_record(ProfileStage stage, uint64_t nanoseconds)
+{
+    thread_local ProfileBuffer* buffer = nullptr;
+    if (!buffer)
+    {
+        buffer = new ProfileBuffer;
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffers.push_back(buffer);
+    }
+    buffer->durations[stage].push_back(nanoseconds);
+}
+
+// Nearest-rank percentile of sorted durations, in microseconds
+static double percentile_us(const std::vector<uint64_t>& sorted, double percent)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+    size_t rank = (size_t)(percent / 100.0 * sorted.size() + 0.999999);
+    rank = std::min(std::max(rank, (size_t)1), sorted.size());
+    return sorted[rank - 1] / 1000.0;
+}
+
+void profile_report(std::ostream& out, unsigned int samples, double seconds)
+{
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+
+    out << "{" << std::endl;
+    out << "  \"samples\": " << samples << "," << std::endl;
+    out << "  \"seconds\": " << seconds << "," << std::endl;
+    out << "  \"samples_per_second\": " << (seconds > 0.0 ? samples / seconds : 0.0) << "," << std::endl;
+    out << "  \"stages\": {" << std::endl;
+
+    for (int stage = 0; stage < PROFILE_STAGE_COUNT; ++stage)
+    {
+        std::vector<uint64_t> durations;
+        for (ProfileBuffer* buffer : buffers)
+        {
+            durations.insert(durations.end(), buffer->durations[stage].begin(), buffer->durations[stage].end());
+        }
+        std::sort(durations.begin(), durations.end());
+
+        uint64_t total = 0;
+        for (uint64_t duration : durations)
+        {
+            total += duration;
+        }
+
+        out << "    \"" << stage_names[stage] << "\": { "
+            << "\"count\": " << durations.size() << ", "
+            << "\"total_ms\": " << total / 1e6 << ", "
+            << "\"p50_us\": " << percentile_us(durations, 50.0) << ", "
+            << "\"p95_us\": " << percentile_us(durations, 95.0) << ", "
+            << "\"p99_us\": " << percentile_us(durations, 99.0) << " }"
+            << (stage + 1 < PROFILE_STAGE_COUNT ? "," : "") << std::endl;
+    }
+
+    out << "  }" << std::endl;
+    out << "}" << std::endl;
+}
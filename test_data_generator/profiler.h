@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <ostream>
+
+// Per-stage timers for the generator.
+//
+// Each stage of making a sample records how long it took with a
+// ProfileTimer, into a buffer that belongs to the calling thread, so timing
+// doesn't need any locking. profile_report merges the buffers afterwards and
+// gives each stage's latency percentiles. Until profile_enable is called the
+// timers only check a flag.
+
+enum ProfileStage
+{
+    STAGE_RANDOMIZE,        // randomize_state
+    STAGE_COMPUTE_OUTPUTS,  // compute_outputs, mostly the magnetic field
+    STAGE_CACHE_LOOKUP,     // looking for the frame in the render cache, and loading it
+    STAGE_RENDER,           // drawing, including the sensor noise
+    STAGE_READBACK,         // waiting for the GPU and copying the frame out
+    STAGE_OUTPUT_WAIT,      // render threads waiting for a free output frame
+    STAGE_ENCODE_PNG,       // png compression
+    STAGE_CONVERT,          // conversion to Lepton pixels
+    STAGE_WRITE,            // file writes
+    PROFILE_STAGE_COUNT
+};
+
+extern bool profile_enabled;
+
+void profile_enable();
+
+// Adds one measurement of `stage`
+void profile_record(ProfileStage stage, uint64_t nanoseconds);
+
+// Times the scope it's declared in
+struct ProfileTimer
+{
+    ProfileStage stage;
+    std::chrono::steady_clock::time_point start;
+
+    ProfileTimer(ProfileStage stage): stage(stage)
+    {
+        if (profile_enabled)
+        {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ProfileTimer()
+    {
+        if (profile_enabled)
+        {
+            std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+            profile_record(stage, elapsed.count());
+        }
+    }
+};
+
+// Writes everything recorded so far as a JSON object: the sample count,
+// wall-clock time and throughput, then the count, total and p50/p95/p99
+// latency of each stage. All threads that recorded anything must be done.
+void profile_report(std::ostream& out, unsigned int samples, double seconds);
@@ -0,0 +1,155 @@
+#include "render_cache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static RenderCacheKey make_key(const RenderCache* cache, const SimulationState& state)
+{
+    RenderCacheKey key;
+    memset(&key, 0, sizeof(key));
+    key.output_key = cache->output_key;
+    key.nadir[0] = state.nadir.x;
+    key.nadir[1] = state.nadir.y;
+    key.nadir[2] = state.nadir.z;
+    key.altitude = state.altitude;
+    key.visible_atmosphere_height = state.visible_atmosphere_height;
+    key.noise_seed = state.noise_seed;
+    key.noise_stdev = state.noise_stdev;
+    key.K1 = state.K1;
+    key.K2 = state.K2;
+    key.horizontal_fov = state.horizontal_fov;
+    return key;
+}
+
+// <directory>/<first two hex digits>/<hash>.frame, so no directory gets
+// more than a few thousand files even for big runs
+static std::string key_filename(const RenderCache* cache, const RenderCacheKey& key)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const uint8_t* bytes = (const uint8_t*)&key;
+    for (size_t i = 0; i < sizeof(key); ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%02x/%016llx.frame", (unsigned int)(hash >> 56), (unsigned long long)hash);
+    return cache->directory + "/" + name;
+}
+
+int render_cache_open(RenderCache* cache, const char* directory, const RenderState& render_state)
+{
+    cache->directory = directory;
+    cache->output_key = render_output_key(render_state);
+    cache->width = render_state.camera_width;
+    cache->height = render_state.camera_height;
+
+    mkdir(directory, 0755);
+    for (unsigned int i = 0; i < 256; ++i)
+    {
+        char subdirectory[8];
+        snprintf(subdirectory, sizeof(subdirectory), "/%02x", i);
+        std::string path = cache->directory + subdirectory;
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            perror(path.c_str());
+            return -1;
+        }
+    }
+    return 0;
+}
+
+bool render_cache_load(RenderCache* cache, const SimulationState& state, CapturedFrame* frame)
+{
+    RenderCacheKey key = make_key(cache, state);
+    std::ifstream file(key_filename(cache, key), std::ios::binary | std::ios::ate);
+    std::streamoff file_size = file.tellg();
+    file.seekg(0);
+
+    // The size is only trusted once it matches both the renderer and the
+    // file, so a corrupt header can't ask for a huge frame
+    size_t pixel_count = (size_t)cache->width * cache->height;
+    RenderCacheHeader header;
+    if (!file.read((char*)&header, sizeof(header))
+        || memcmp(header.magic, RENDER_CACHE_MAGIC, sizeof(RENDER_CACHE_MAGIC)) != 0
+        || header.version != RENDER_CACHE_VERSION
+        || memcmp(&header.key, &key, sizeof(key)) != 0
+        || header.width != cache->width || header.height != cache->height
+        || file_size != (std::streamoff)(sizeof(header) + pixel_count * sizeof(uint16_t)))
+    {
+        cache->misses++;
+        return false;
+    }
+
+    frame->width = header.width;
+    frame->height = header.height;
+    frame->pixels.resize(pixel_count);
+    if (!file.read((char*)frame->pixels.data(), frame->pixels.size() * sizeof(uint16_t)))
+    {
+        cache->misses++;
+        return false;
+    }
+
+    cache->hits++;
+    return true;
+}
+
+void render_cache_store(RenderCache* cache, const CapturedFrame& frame)
+{
+    RenderCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RENDER_CACHE_MAGIC, sizeof(RENDER_CACHE_MAGIC));
+    header.version = RENDER_CACHE_VERSION;
+    header.width = frame.width;
+    header.height = frame.height;
+    header.key = make_key(cache, frame.state);
+
+    // Each writer thread renames its own file into place, the same frame can
+    // be stored by two threads or processes at once
+    std::string filename = key_filename(cache, header.key);
+    std::ostringstream temp_filename;
+    temp_filename << filename << "." << getpid() << "." << std::this_thread::get_id();
+    {
+        std::ofstream file(temp_filename.str(), std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)frame.pixels.data(), frame.pixels.size() * sizeof(uint16_t));
+        if (!file)
+        {
+            file.close();
+            unlink(temp_filename.str().c_str());
+            cache->store_failures++;
+            return;
+        }
+    }
+    if (rename(temp_filename.str().c_str(), filename.c_str()) != 0)
+    {
+        unlink(temp_filename.str().c_str());
+        cache->store_failures++;
+        return;
+    }
+    cache->stored++;
+}
+
+void render_cache_report(const RenderCache* cache)
+{
+    cout << "Render cache " << cache->directory << ": " << cache->hits << " frames reused, " << cache->misses
+         << " rendered, " << cache->stored << " added";
+    if (cache->store_failures)
+    {
+        cout << ", " << cache->store_failures << " couldn't be written";
+    }
+    cout << endl;
+}
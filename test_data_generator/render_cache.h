@@ -0,0 +1,87 @@
+#pragma once
+
+#include "capture.h"
+#include "rendering.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// Content-addressed store of rendered frames (--cache)
+//
+// Each frame is kept in its own file, named after a hash of everything it was
+// rendered from: the state's render inputs below and render_output_key. A run
+// checks the cache before rendering a sample, so rerunning a run that was
+// interrupted only renders what it hadn't got to, and a run that only changes
+// what the image doesn't depend on (mag_reading, --mag_stdev, --geomag_grid,
+// the output formats) renders nothing at all. Fuzzing another parameter
+// changes the values drawn after it, so it only reuses frames if nothing the
+// image depends on is drawn later (see randomize_state).
+//
+// Files are written under another name and renamed into place, so an
+// interrupted write never leaves a partial frame, and any number of threads
+// or processes can share a directory. Every file holds the full key it was
+// stored under, which is checked on loading, so a hash collision is a miss
+// rather than the wrong frame.
+
+#define RENDER_CACHE_MAGIC "HRZFRAM"
+#define RENDER_CACHE_VERSION 1
+
+#pragma pack(push, 1)
+// The state's render inputs, which are all the renderers read from it. The
+// camera orientation only matters through the nadir vector, since the Earth
+// looks the same rolled about it. Anything a renderer starts reading from the
+// state has to be added here.
+struct RenderCacheKey
+{
+    uint64_t output_key;    // render_output_key
+    float nadir[3];
+    float altitude;
+    float visible_atmosphere_height;
+    int32_t noise_seed;
+    float noise_stdev;
+    float K1;
+    float K2;
+    float horizontal_fov;
+};
+
+struct RenderCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    RenderCacheKey key;
+};
+#pragma pack(pop)
+
+struct RenderCache
+{
+    std::string directory;
+    uint64_t output_key = 0;
+
+    // Every frame in the cache is the renderer's camera resolution
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    // Statistics, reported by render_cache_report
+    std::atomic<unsigned long long> hits{0};
+    std::atomic<unsigned long long> misses{0};
+    std::atomic<unsigned long long> stored{0};
+    std::atomic<unsigned long long> store_failures{0};
+};
+
+// Uses `directory` as the cache for frames drawn by `render_state`'s
+// renderer, creating it if needed. Returns 0 on success.
+int render_cache_open(RenderCache* cache, const char* directory, const RenderState& render_state);
+
+// Fills frame->pixels, width and height with the frame `state` renders to, if
+// it's in the cache. Returns true if it was.
+bool render_cache_load(RenderCache* cache, const SimulationState& state, CapturedFrame* frame);
+
+// Adds a rendered frame to the cache. Failing to isn't fatal, it's counted
+// and the frame is rendered again next time.
+void render_cache_store(RenderCache* cache, const CapturedFrame& frame);
+
+// Prints the hits, misses and frames added
+void render_cache_report(const RenderCache* cache);
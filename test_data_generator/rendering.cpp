@@ -1,12 +1,22 @@
 #include "rendering.h"
+#include "embedded_shaders.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include <iostream>
 #include <fstream>
-#include <random>
+#include <sstream>
+#include <mutex>
+#include <string>
+#include <thread>
 
 using std::cout;
 using std::cerr;
@@ -24,32 +34,20 @@ struct Vertex
 
 static_assert(sizeof(Vertex) == 2 * sizeof(Vec3), "Vertex has to be packed");
 
-static GLint compile_shader(const char* filename, GLuint shader_type)
+static GLint compile_shader(const char* name, const char* source, GLuint shader_type)
 {
-    std::ifstream shader_file;
-    shader_file.open(filename, std::ios::ate | std::ios::binary);
-    size_t file_len = shader_file.tellg();
-    GLchar* shader_text = (GLchar*) malloc(file_len + 1); // +1 for null terminator
-    shader_file.seekg(0, std::ios::beg);
-    shader_file.read(shader_text, file_len);
-
-    // add null terminator
-    shader_text[file_len] = 0;
-
     GLuint shader = glCreateShader(shader_type);
 
-    glShaderSource(shader, 1, &shader_text, NULL);
+    glShaderSource(shader, 1, &source, NULL);
     glCompileShader(shader);
 
-    free(shader_text);
-
     GLint log_size = 0;
     glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_size);
     if (log_size > 1)
     {
         GLchar* info_log = (GLchar*)malloc(log_size);
         glGetShaderInfoLog(shader, log_size, NULL, info_log);
-        cout << filename  << " info log: "
+        cout << name  << " info log: "
              << info_log
              << endl;
         free(info_log);
@@ -70,6 +68,7 @@ static GLuint link_program(GLint vshader, GLint fshader)
     GLuint program = glCreateProgram();
     glAttachShader(program, vshader);
     glAttachShader(program, fshader);
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
 
     GLint success = 0;
@@ -88,6 +87,154 @@ static GLuint link_program(GLint vshader, GLint fshader)
     return program;
 }
 
+// Linked programs are saved with glGetProgramBinary so later runs can skip
+// compiling and linking. A cache file is only used if it was made from the
+// same shader source by the same driver, otherwise it's replaced.
+#define PROGRAM_CACHE_MAGIC "HRZPROG"
+
+struct ProgramCacheHeader
+{
+    char magic[8];
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+static uint64_t fnv1a(uint64_t hash, const char* text)
+{
+    for (; *text; ++text)
+    {
+        hash ^= (uint8_t)*text;
+        hash *= 0x100000001b3ull;
+    }
+    // Separates consecutive strings
+    hash ^= 0xff;
+    hash *= 0x100000001b3ull;
+    return hash;
+}
+
+// $HORIZON_PROGRAM_CACHE, or horizon_detection in the user's cache directory.
+// Empty if there's nowhere to put the cache.
+static std::string program_cache_directory()
+{
+    const char* override_dir = getenv("HORIZON_PROGRAM_CACHE");
+    if (override_dir)
+    {
+        return override_dir;
+    }
+
+    std::string cache_dir;
+    const char* xdg_cache = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (xdg_cache && *xdg_cache)
+    {
+        cache_dir = xdg_cache;
+    }
+    else if (home && *home)
+    {
+        cache_dir = std::string(home) + "/.cache";
+    }
+    else
+    {
+        return "";
+    }
+    mkdir(cache_dir.c_str(), 0755);
+    return cache_dir + "/horizon_detection";
+}
+
+static GLuint load_program(const char* name, const char* vertex_source, const char* fragment_source)
+{
+    GLint binary_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_formats);
+    std::string cache_dir = binary_formats > 0 ? program_cache_directory() : "";
+
+    uint64_t key = 0xcbf29ce484222325ull;
+    key = fnv1a(key, (const char*)glGetString(GL_VENDOR));
+    key = fnv1a(key, (const char*)glGetString(GL_RENDERER));
+    key = fnv1a(key, (const char*)glGetString(GL_VERSION));
+    key = fnv1a(key, vertex_source);
+    key = fnv1a(key, fragment_source);
+
+    std::string cache_filename = cache_dir + "/" + name + ".bin";
+    if (!cache_dir.empty())
+    {
+        std::ifstream cache_file(cache_filename, std::ios::binary);
+        ProgramCacheHeader header;
+        if (cache_file.read((char*)&header, sizeof(header))
+            && memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) == 0
+            && header.key == key)
+        {
+            std::vector<char> binary(header.length);
+            if (cache_file.read(binary.data(), binary.size()))
+            {
+                GLuint program = glCreateProgram();
+                glProgramBinary(program, header.format, binary.data(), binary.size());
+
+                // Drivers can refuse binaries, e.g. after an update that
+                // didn't change the version string
+                GLint success = 0;
+                glGetProgramiv(program, GL_LINK_STATUS, &success);
+                if (success == GL_TRUE)
+                {
+                    return program;
+                }
+                glDeleteProgram(program);
+            }
+        }
+    }
+
+    std::string vertex_name = std::string(name) + ".vert";
+    std::string fragment_name = std::string(name) + ".frag";
+    GLint vshader = compile_shader(vertex_name.c_str(), vertex_source, GL_VERTEX_SHADER);
+    GLint fshader = compile_shader(fragment_name.c_str(), fragment_source, GL_FRAGMENT_SHADER);
+    GLuint program = link_program(vshader, fshader);
+    glDeleteShader(vshader);
+    glDeleteShader(fshader);
+
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (cache_dir.empty() || success == GL_FALSE)
+    {
+        return program;
+    }
+
+    ProgramCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+    header.key = key;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    header.format = format;
+    header.length = length;
+
+    // Offscreen render threads can get here at the same time, so each writes
+    // its own file and renames it into place
+    mkdir(cache_dir.c_str(), 0755);
+    std::ostringstream temp_filename;
+    temp_filename << cache_filename << "." << getpid() << "." << std::this_thread::get_id();
+    {
+        std::ofstream cache_file(temp_filename.str(), std::ios::binary);
+        cache_file.write((const char*)&header, sizeof(header));
+        cache_file.write(binary.data(), length);
+        if (!cache_file)
+        {
+            // Not fatal, the next run compiles again
+            cache_file.close();
+            unlink(temp_filename.str().c_str());
+            return program;
+        }
+    }
+    if (rename(temp_filename.str().c_str(), cache_filename.c_str()) != 0)
+    {
+        unlink(temp_filename.str().c_str());
+    }
+
+    return program;
+}
+
 static void make_perspective_matrix(float* data, float near, float far, float fov, float aspect_ratio)
 {
     float csc_fov = 1.0f / sinf(fov * 0.5f);
@@ -102,143 +249,279 @@ static void make_perspective_matrix(float* data, float near, float far, float fo
     memcpy(data, matrix_data, sizeof(matrix_data));
 }
 
-void render_frame(RenderState render_state, SimulationState state, uint32_t width, uint32_t height)
+// One entry of the Samples uniform block in screen_shader.vert, laid out by
+// the std140 rules
+struct SampleUniforms
+{
+    float nadir[3];
+    float alpha;
+    float alpha_atmosphere;
+    float noise_stdev;
+    uint32_t noise_seed;
+    uint32_t padding[1];
+};
+
+static_assert(sizeof(SampleUniforms) == 32, "SampleUniforms has to match the std140 layout of Sample");
+
+// A context's textures of the DISTORTION_CACHE_SIZE distortion tables it drew
+// with most recently, most recent first. Holding the tables means a texture
+// can't be mistaken for one of a new table allocated at the same address.
+struct DistortionTextures
 {
-    glViewport(0, 0, width, height);
+    std::vector<std::shared_ptr<const DistortionTable>> tables;
+    std::vector<GLuint> textures;
+};
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// The texture holding `table` in the current context, uploading it the first
+// time. The rays are interleaved into RGBA so the shader needs one fetch.
+static GLuint distortion_texture(const RenderState& render_state, const std::shared_ptr<const DistortionTable>& table)
+{
+    DistortionTextures* cache = render_state.distortion_textures;
+    for (size_t i = 0; i < cache->tables.size(); ++i)
+    {
+        if (cache->tables[i] == table)
+        {
+            std::rotate(cache->tables.begin(), cache->tables.begin() + i, cache->tables.begin() + i + 1);
+            std::rotate(cache->textures.begin(), cache->textures.begin() + i, cache->textures.begin() + i + 1);
+            return cache->textures.front();
+        }
+    }
 
-    glUseProgram(render_state.screen_shader);
+    size_t pixels = (size_t)table->width * table->height;
+    std::vector<float> texels(4 * pixels);
+    for (size_t i = 0; i < pixels; ++i)
+    {
+        texels[4 * i + 0] = table->ray_x()[i];
+        texels[4 * i + 1] = table->ray_y()[i];
+        texels[4 * i + 2] = table->ray_z()[i];
+        texels[4 * i + 3] = 0.0f;
+    }
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, table->width, table->height, 0, GL_RGBA, GL_FLOAT, texels.data());
+
+    // GL keeps a deleted texture around until draws already issued with it
+    // are done, so evicting one used earlier in the batch is safe
+    if (cache->textures.size() == DISTORTION_CACHE_SIZE)
+    {
+        glDeleteTextures(1, &cache->textures.back());
+        cache->tables.pop_back();
+        cache->textures.pop_back();
+    }
+    cache->tables.insert(cache->tables.begin(), table);
+    cache->textures.insert(cache->textures.begin(), texture);
+    return texture;
+}
 
-    glBindTexture(GL_TEXTURE_2D, render_state.noise_texture);
+void render_atlas_size(const RenderState& render_state, unsigned int count, unsigned int* columns, unsigned int* rows)
+{
+    *columns = count < render_state.atlas_columns ? count : render_state.atlas_columns;
+    *rows = (count + *columns - 1) / *columns;
+}
 
-    GLint location = glGetUniformLocation(render_state.screen_shader, "nadir");
-    glUniform3fv(location, 1, (GLfloat*)&state.nadir);
+void render_frame(RenderState render_state, SimulationState state, uint32_t width, uint32_t height)
+{
+    render_batch(render_state, &state, 1, width, height);
+}
 
-    location = glGetUniformLocation(render_state.screen_shader, "screen_width");
-    glUniform1ui(location, width);
+void render_batch(const RenderState& render_state, const SimulationState* states, unsigned int count, uint32_t width, uint32_t height)
+{
+    unsigned int columns, rows;
+    render_atlas_size(render_state, count, &columns, &rows);
 
-    location = glGetUniformLocation(render_state.screen_shader, "screen_height");
-    glUniform1ui(location, height);
+    SampleUniforms samples[RENDER_BATCH_MAX];
+    std::shared_ptr<const DistortionTable> tables[RENDER_BATCH_MAX];
+    memset(samples, 0, count * sizeof(SampleUniforms));
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        const SimulationState& state = states[i];
+        tables[i] = distortion_table(state.K1, state.K2, state.horizontal_fov, width, height);
+        samples[i].nadir[0] = state.nadir.x;
+        samples[i].nadir[1] = state.nadir.y;
+        samples[i].nadir[2] = state.nadir.z;
+        samples[i].alpha = cosf(asinf(EARTH_RADIUS / (EARTH_RADIUS + state.altitude)));
+        samples[i].alpha_atmosphere = cosf(asinf((EARTH_RADIUS + state.visible_atmosphere_height) / (EARTH_RADIUS + state.altitude)));
+        samples[i].noise_stdev = state.noise_stdev;
+        samples[i].noise_seed = (uint32_t)state.noise_seed;
+    }
 
-    location = glGetUniformLocation(render_state.screen_shader, "alpha");
-    glUniform1f(location, cosf(asinf(EARTH_RADIUS / (EARTH_RADIUS + state.altitude))));
+    // Orphaning the old contents means the driver doesn't have to wait for
+    // a batch still being drawn from them
+    glBindBuffer(GL_UNIFORM_BUFFER, render_state.samples_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(samples), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, count * sizeof(SampleUniforms), samples);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    location = glGetUniformLocation(render_state.screen_shader, "alpha_atmosphere");
-    glUniform1f(location, cosf(asinf((EARTH_RADIUS + state.visible_atmosphere_height) / (EARTH_RADIUS + state.altitude))));
+    glViewport(0, 0, columns * width, rows * height);
 
-    location = glGetUniformLocation(render_state.screen_shader, "K1");
-    glUniform1f(location, state.K1);
+    // glClear ignores the viewport, and the offscreen framebuffer has room
+    // for a whole atlas
+    glScissor(0, 0, columns * width, rows * height);
+    glEnable(GL_SCISSOR_TEST);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+
+    glUseProgram(render_state.screen_shader);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, render_state.samples_buffer);
 
-    location = glGetUniformLocation(render_state.screen_shader, "K2");
-    glUniform1f(location, state.K2);
+    glUniform1ui(render_state.screen_width_location, width);
+    glUniform1ui(render_state.screen_height_location, height);
+    glUniform1ui(render_state.camera_width_location, render_state.camera_width);
+    glUniform1ui(render_state.camera_height_location, render_state.camera_height);
+    glUniform1ui(render_state.atlas_columns_location, columns);
+    glUniform1ui(render_state.atlas_rows_location, rows);
 
+    glActiveTexture(GL_TEXTURE0);
     glBindVertexArray(render_state.screen_mesh.vao);
-    glDrawArrays(
-        GL_TRIANGLES,
-        0,  // starting idx
-        (int) render_state.screen_mesh.size
-    );
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
+    // One draw for each run of samples with the same lens, which is usually
+    // the whole batch
+    unsigned int first = 0;
+    while (first < count)
+    {
+        unsigned int end = first + 1;
+        while (end < count && tables[end] == tables[first])
+        {
+            ++end;
+        }
 
-void export_image(const char* filename, RenderState render_state, SimulationState state)
-{
-    render_frame(render_state, state, CAMERA_WIDTH, CAMERA_HEIGHT);
-
-    uint8_t pixels[CAMERA_WIDTH * CAMERA_HEIGHT];
-    glReadnPixels(
-        0, 0,
-        CAMERA_WIDTH, CAMERA_HEIGHT,
-        GL_RED, // rendering is monochrome, but the buffer isn't
-        GL_UNSIGNED_BYTE,
-        sizeof(pixels),
-        pixels);
-
-    stbi_flip_vertically_on_write(1);
-    stbi_write_png(filename, CAMERA_WIDTH, CAMERA_HEIGHT, 1, pixels, CAMERA_WIDTH);
-    stbi_flip_vertically_on_write(0);
+        glBindTexture(GL_TEXTURE_2D, distortion_texture(render_state, tables[first]));
+        glUniform1ui(render_state.instance_offset_location, first);
+        glDrawArraysInstanced(
+            GL_TRIANGLES,
+            0,  // starting idx
+            (int) render_state.screen_mesh.size,
+            end - first
+        );
+
+        first = end;
+    }
 }
 
-void export_binary(const char* filename, RenderState render_state, SimulationState state)
+// Creates a GL 4.2 context that isn't attached to any window or surface and
+// makes it current on the calling thread
+static bool create_offscreen_context(RenderState* render_state)
 {
-    render_frame(render_state, state, CAMERA_WIDTH, CAMERA_HEIGHT);
+    EGLDisplay display = EGL_NO_DISPLAY;
 
-    int num_pixels = CAMERA_WIDTH * CAMERA_HEIGHT;
+    // Prefer a display that doesn't need a windowing system at all
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display)
+    {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (display == EGL_NO_DISPLAY)
+    {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
 
-    uint16_t pixels[num_pixels];
-    glReadnPixels(
-        0, 0,
-        CAMERA_WIDTH, CAMERA_HEIGHT,
-        GL_RED,             // we want a grayscale image
-        GL_UNSIGNED_SHORT,  // and 16-bit pixel values
-        sizeof(pixels),
-        pixels);
+    if (!eglInitialize(display, NULL, NULL))
+    {
+        cerr << "Error initializing EGL: 0x" << std::hex << eglGetError() << std::dec << endl;
+        return false;
+    }
 
-    // The Lepton 3.5 data format actually only uses 14 bits per pixel
-    // with the upper two bits set to zero, so we'll discard the two LSb.
-    
-    for (int i = 0; i < num_pixels; i++)
+    if (!eglBindAPI(EGL_OPENGL_API))
     {
-        pixels[i] = pixels[i] >> 2;
+        cerr << "EGL doesn't support desktop OpenGL" << endl;
+        return false;
     }
 
-    // The output from glReadnPixels is flipped so we need to swap all the rows
-    for (int i = 0; i < CAMERA_HEIGHT / 2; ++i)
+    // The default surface type is window, and there is no window
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, 0,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0)
     {
-        for (int j = 0; j < CAMERA_WIDTH; ++j)
-        {
-            std::swap(pixels[i*CAMERA_WIDTH + j], pixels[(CAMERA_HEIGHT - i - 1)*CAMERA_WIDTH + j]);
-        }
+        cerr << "No EGL config supports OpenGL" << endl;
+        return false;
     }
 
-    FILE* fd = fopen(filename, "wb");
-    fwrite(pixels, sizeof(uint16_t), num_pixels, fd);
-    fclose(fd);
-}
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 2,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT)
+    {
+        cerr << "Error creating EGL context: 0x" << std::hex << eglGetError() << std::dec << endl;
+        return false;
+    }
 
-void generate_noise(int seed, float stdev, RenderState* render_state)
-{
-    std::default_random_engine random_engine(seed);
-    std::normal_distribution<float> normal_dist(0.0f, stdev);
-    for (size_t i = 0; i < CAMERA_WIDTH * CAMERA_HEIGHT; ++i)
+    // No surface and so no swap interval, everything is drawn to a framebuffer object
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
     {
-        render_state->noise[i] = normal_dist(random_engine);
+        cerr << "Error making EGL context current (EGL_KHR_surfaceless_context is needed): 0x"
+             << std::hex << eglGetError() << std::dec << endl;
+        return false;
     }
 
-    glTextureSubImage2D(render_state->noise_texture, 0, 0, 0, CAMERA_WIDTH, CAMERA_HEIGHT, GL_RED, GL_FLOAT, render_state->noise);
+    render_state->egl_display = display;
+    render_state->egl_context = context;
+    return true;
 }
 
-RenderState render_init(unsigned int screen_width, unsigned int screen_height)
+bool render_open(RenderState* render_state, Renderer renderer, uint32_t camera_width, uint32_t camera_height)
 {
-    RenderState render_state;
+    *render_state = RenderState();
+    render_state->renderer = renderer;
+    render_state->camera_width = camera_width;
+    render_state->camera_height = camera_height;
 
-    SDL_Init(SDL_INIT_VIDEO);
+    if (renderer == RENDERER_CPU)
+    {
+        return true;
+    }
+    if (renderer != RENDERER_GL_OFFSCREEN)
+    {
+        cerr << "The gl renderer needs a window, see window.h" << endl;
+        return false;
+    }
 
-    render_state.window = SDL_CreateWindow(
-        "ECE 499 Test Image Generator",
-        SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-        screen_width, screen_height,
-        SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    {
+        // glewInit writes to globals, so set up one context at a time
+        static std::mutex init_mutex;
+        std::lock_guard<std::mutex> lock(init_mutex);
 
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
-    render_state.gl_ctxt = SDL_GL_CreateContext(render_state.window);
+        if (!create_offscreen_context(render_state))
+        {
+            return false;
+        }
 
-    // Enable VSync
-    if (SDL_GL_SetSwapInterval(1) < 0)
-    {
-        cerr << "Error enabling vsync" << endl;
+        // Without a GLX display glewInit gives up after it has loaded the core
+        // GL functions, which are all we need
+        GLenum err = glewInit();
+        if (err != GLEW_OK && err != GLEW_ERROR_NO_GLX_DISPLAY)
+        {
+            cerr << "Error loading gl bindings: "
+                 << glewGetErrorString(err) << endl;
+        }
     }
 
-    // load gl bindings
-    GLenum err = glewInit();
-    if (err != GLEW_OK)
+    if (!render_init_context(render_state))
     {
-        cerr << "Error loading gl bindings: "
-             << glewGetErrorString(err) << endl;
+        render_cleanup(render_state);
+        return false;
     }
+    return true;
+}
+
+bool render_init_context(RenderState* render_state)
+{
+    uint32_t camera_width = render_state->camera_width;
+    uint32_t camera_height = render_state->camera_height;
+
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
     {
@@ -297,30 +580,116 @@ RenderState render_init(unsigned int screen_width, unsigned int screen_height)
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
 
-        render_state.screen_mesh.vao = vao;
-        render_state.screen_mesh.size = sizeof(screen_mesh) / sizeof(*screen_mesh);
+        render_state->screen_mesh.vao = vao;
+        render_state->screen_mesh.size = sizeof(screen_mesh) / sizeof(*screen_mesh);
     }
 
-    // noise texture
+    // The shader source is compiled in (embedded_shaders.h is generated from
+    // screen_shader.vert and .frag by the Makefile)
+    render_state->screen_shader = load_program("screen_shader", screen_shader_vert, screen_shader_frag);
+
     {
-        glGenTextures(1, &render_state.noise_texture);
-        glBindTexture(GL_TEXTURE_2D, render_state.noise_texture);
+        GLuint program = render_state->screen_shader;
+        render_state->screen_width_location = glGetUniformLocation(program, "screen_width");
+        render_state->screen_height_location = glGetUniformLocation(program, "screen_height");
+        render_state->camera_width_location = glGetUniformLocation(program, "camera_width");
+        render_state->camera_height_location = glGetUniformLocation(program, "camera_height");
+        render_state->atlas_columns_location = glGetUniformLocation(program, "atlas_columns");
+        render_state->atlas_rows_location = glGetUniformLocation(program, "atlas_rows");
+        render_state->instance_offset_location = glGetUniformLocation(program, "instance_offset");
+        glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Samples"), 0);
+
+        // Texture unit 0 never changes
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "distortion_rays"), 0);
+        glUseProgram(0);
+        render_state->distortion_textures = new DistortionTextures;
+
+        glGenBuffers(1, &render_state->samples_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, render_state->samples_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, RENDER_BATCH_MAX * sizeof(SampleUniforms), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // The default framebuffer only has 8 bits per channel, so offscreen
+    // rendering goes to a 16-bit one, big enough for a full atlas of camera
+    // frames from render_batch. Big frames get a smaller atlas, within the
+    // driver's limit and RENDER_ATLAS_BYTES.
+    if (render_state->renderer == RENDERER_GL_OFFSCREEN)
+    {
+        GLint max_size = 0;
+        glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_size);
+        unsigned int columns = std::min<unsigned int>(RENDER_ATLAS_COLUMNS, max_size / camera_width);
+        unsigned int rows = std::min<unsigned int>(RENDER_BATCH_MAX / RENDER_ATLAS_COLUMNS, max_size / camera_height);
+        if (columns == 0 || rows == 0)
+        {
+            cerr << "Frames of " << camera_width << "x" << camera_height << " are bigger than the driver's "
+                 << max_size << "x" << max_size << " limit" << endl;
+            return false;
+        }
+        size_t frame_bytes = (size_t)camera_width * camera_height * sizeof(uint16_t);
+        size_t batch_max = std::min<size_t>(columns * rows, RENDER_ATLAS_BYTES / frame_bytes);
+        render_state->batch_max = std::max<size_t>(batch_max, 1);
+        render_state->atlas_columns = std::min(columns, render_state->batch_max);
+        rows = (render_state->batch_max + render_state->atlas_columns - 1) / render_state->atlas_columns;
+
+        glGenRenderbuffers(1, &render_state->color_renderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, render_state->color_renderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_R16, render_state->atlas_columns * camera_width, rows * camera_height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &render_state->framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, render_state->framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, render_state->color_renderbuffer);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            cerr << "Offscreen framebuffer is incomplete" << endl;
+        }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, CAMERA_WIDTH, CAMERA_HEIGHT, 0, GL_RED, GL_FLOAT, render_state.noise);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        // Left bound, everything this context draws goes here
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
     }
 
-    render_state.noise = new float[CAMERA_WIDTH * CAMERA_HEIGHT];
-    generate_noise(0.0f, 0.01f, &render_state);
+    return true;
+}
+
+void render_cleanup(RenderState* render_state)
+{
+    if (render_state->distortion_textures)
+    {
+        // Called while the context is still current
+        DistortionTextures* cache = render_state->distortion_textures;
+        glDeleteTextures(cache->textures.size(), cache->textures.data());
+        delete render_state->distortion_textures;
+        render_state->distortion_textures = nullptr;
+    }
 
-    render_state.screen_shader = link_program(
-        compile_shader("screen_shader.vert", GL_VERTEX_SHADER),
-        compile_shader("screen_shader.frag", GL_FRAGMENT_SHADER));
+    if (render_state->renderer == RENDERER_GL_OFFSCREEN)
+    {
+        // Destroying the context frees everything created in it. The display
+        // is shared with any other offscreen contexts, so it's left alone.
+        EGLDisplay display = (EGLDisplay)render_state->egl_display;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, (EGLContext)render_state->egl_context);
+        eglReleaseThread();
+    }
+}
 
-    return render_state;
+uint64_t render_output_key(const RenderState& render_state)
+{
+    uint64_t key = 0xcbf29ce484222325ull;
+    std::string identity = std::to_string(RENDER_VERSION) + " " + std::to_string(render_state.renderer) + " "
+                           + std::to_string(render_state.camera_width) + "x" + std::to_string(render_state.camera_height);
+    key = fnv1a(key, identity.c_str());
+    if (render_state.renderer != RENDERER_CPU)
+    {
+        // Drivers round differently, so a driver update can change frames
+        key = fnv1a(key, (const char*)glGetString(GL_VENDOR));
+        key = fnv1a(key, (const char*)glGetString(GL_RENDERER));
+        key = fnv1a(key, (const char*)glGetString(GL_VERSION));
+        key = fnv1a(key, screen_shader_vert);
+        key = fnv1a(key, screen_shader_frag);
+    }
+    return key;
 }
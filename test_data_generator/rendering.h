@@ -2,8 +2,8 @@
 
 #include "math3d.h"
 #include "sim.h"
+#include "distortion.h"
 
-#include <SDL/SDL.h>
 #include <GL/glew.h>
 
 struct Mesh
@@ -12,21 +12,102 @@ struct Mesh
     unsigned int size;
 };
 
+enum Renderer
+{
+    RENDERER_GL,            // screen_shader.frag through an SDL window's GL context
+    RENDERER_GL_OFFSCREEN,  // screen_shader.frag into a 16-bit framebuffer object, through a surfaceless EGL context
+    RENDERER_CPU            // cpu_renderer.cpp, no window or GL context needed
+};
+
+// Most frames render_batch can draw at once, the size of the Samples block
+// in screen_shader.vert
+#define RENDER_BATCH_MAX 256
+
+// Most tiles per row of the atlas render_batch draws into
+#define RENDER_ATLAS_COLUMNS 16
+
+// Most memory the offscreen atlas can take. Batches of big frames are smaller
+// to stay under it.
+#define RENDER_ATLAS_BYTES (64 * 1024 * 1024)
+
+// Goes up whenever the same state would render differently: changes to
+// cpu_renderer.cpp, distortion.cpp, noise.cpp or how frames are read back.
+// The shaders don't need it, render_output_key hashes their source.
+#define RENDER_VERSION 1
+
+// GL textures made from DistortionTables, see rendering.cpp
+struct DistortionTextures;
+
 struct RenderState
 {
-    SDL_Window* window = nullptr;
-    SDL_GLContext gl_ctxt = nullptr;
+    Renderer renderer = RENDERER_GL;
+
+    // Resolution of the sensor frames are captured at
+    uint32_t camera_width = LEPTON_WIDTH;
+    uint32_t camera_height = LEPTON_HEIGHT;
+
+    // Most frames the offscreen framebuffer has room for at once, and the
+    // tiles per row of its atlas
+    unsigned int batch_max = RENDER_BATCH_MAX;
+    unsigned int atlas_columns = RENDER_ATLAS_COLUMNS;
+
+    // Only used by RENDERER_GL, an SDL_Window and its SDL_GLContext (see
+    // window.h). Nothing else needs SDL.
+    void* window = nullptr;
+    void* gl_ctxt = nullptr;
+
+    // Only used by RENDERER_GL_OFFSCREEN
+    void* egl_display = nullptr;
+    void* egl_context = nullptr;
+    GLuint framebuffer = 0;
+    GLuint color_renderbuffer = 0;
 
     Mesh screen_mesh;
     GLint screen_shader = -1;
 
-    GLuint noise_texture = -1;
-    float* noise = nullptr;
+    // Looked up once in render_init rather than on every draw
+    GLint screen_width_location = -1;
+    GLint screen_height_location = -1;
+    GLint camera_width_location = -1;
+    GLint camera_height_location = -1;
+    GLint atlas_columns_location = -1;
+    GLint atlas_rows_location = -1;
+    GLint instance_offset_location = -1;
+
+    // Per-sample parameters for screen_shader.vert's Samples block
+    GLuint samples_buffer = 0;
+
+    // This context's copy of each distortion table it has drawn with
+    DistortionTextures* distortion_textures = nullptr;
 };
 
-RenderState render_init(unsigned int screen_width, unsigned int screen_height);
+// Sets up the cpu or offscreen renderer, neither of which needs a window.
+// The offscreen renderer's GL context is made current on the calling thread.
+// Captured frames are camera_width x camera_height. Returns false, having
+// printed why, if the renderer can't be used.
+bool render_open(RenderState* render_state, Renderer renderer, uint32_t camera_width, uint32_t camera_height);
+
+// Creates the shader, mesh and buffers in the calling thread's GL context.
+// render_open does this itself, window_init calls it for RENDERER_GL.
+bool render_init_context(RenderState* render_state);
+
+// Frees what render_open made. Windows are closed by window_cleanup.
+void render_cleanup(RenderState* render_state);
+
+// Draws `state`, including its sensor noise, into the current framebuffer
 void render_frame(RenderState render_state, SimulationState state, uint32_t width, uint32_t height);
-void export_image(const char* filename, RenderState render_state, SimulationState state);
-void export_binary(const char* filename, RenderState render_state, SimulationState state);
 
-void generate_noise(int seed, float stdev, RenderState* render_state);
+// Draws `count` states (at most render_state.batch_max) with a single
+// instanced draw call, each into its own width x height tile of an atlas in
+// the current framebuffer. The atlas has min(count, render_state.atlas_columns)
+// columns, and state i goes in column i % columns of row i / columns,
+// counting rows from the bottom.
+void render_batch(const RenderState& render_state, const SimulationState* states, unsigned int count, uint32_t width, uint32_t height);
+
+// Number of columns and rows of tiles render_batch uses for `count` states
+void render_atlas_size(const RenderState& render_state, unsigned int count, unsigned int* columns, unsigned int* rows);
+
+// Hash of everything besides the state that captured frames depend on: the
+// renderer, RENDER_VERSION, the camera resolution and, for the GL renderers,
+// the driver and shader source. Needs render_state's context to be current.
+uint64_t render_output_key(const RenderState& render_state);
@@ -0,0 +1,173 @@
+// Compares how evenly the fuzz samplers cover the parameter space.
+//
+// Usage: ./sampler_check [count...]
+//
+// Fuzzes orientation, atmosphere_height, altitude and noise_stdev with every
+// sampler, maps each sample back to a point in the unit cube, and estimates
+// the star discrepancy of the points: the worst difference, over boxes with
+// a corner at the origin, between the fraction of samples in the box and its
+// volume. Orientations are mapped with the inverse of the uniform rotation
+// construction, so a sampler that's uneven over rotations shows up too.
+//
+// The estimate is the worst of a fixed set of random boxes, so it's a lower
+// bound, but the same boxes are used for every sampler and count.
+
+#include "fuzz.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+// Three for the orientation, then one for each range
+static const unsigned int DIMENSIONS = 6;
+static const unsigned int ORIENTATION_DIMENSIONS = 3;
+
+static const unsigned int BOX_COUNT = 4096;
+
+struct Point
+{
+    float u[DIMENSIONS];
+};
+
+// Undoes uniform_rotation in fuzz.cpp. q and -q are the same rotation, so
+// the sign is picked that puts the second angle in [0, pi).
+static void rotation_coordinates(Quaternion q, float* u)
+{
+    float theta2 = atan2f(q.z, q.w);
+    if (theta2 < 0.0f || theta2 >= (float)M_PI)
+    {
+        q.w = -q.w;
+        q.x = -q.x;
+        q.y = -q.y;
+        q.z = -q.z;
+        theta2 = atan2f(q.z, q.w);
+    }
+    float theta1 = atan2f(q.x, q.y);
+    if (theta1 < 0.0f)
+    {
+        theta1 += 2.0f * M_PI;
+    }
+
+    u[0] = q.w * q.w + q.z * q.z;
+    u[1] = theta1 / (2.0f * M_PI);
+    u[2] = std::max(theta2, 0.0f) / M_PI;
+}
+
+static float unit(float value, float min, float max)
+{
+    return (value - min) / (max - min);
+}
+
+static std::vector<Point> sample(Sampler sampler, unsigned int count)
+{
+    FuzzOptions fuzz;
+    fuzz.orientation = true;
+    fuzz.atmosphere_height = true;
+    fuzz.altitude = true;
+    fuzz.noise_stdev = true;
+    fuzz.sampler = sampler;
+    fuzz.count = count;
+
+    std::vector<Point> points(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        SimulationState state;
+        randomize_state(&state, &fuzz, i);
+        state.camera.normalize();
+
+        float* u = points[i].u;
+        rotation_coordinates(state.camera, u);
+        u[3] = unit(state.visible_atmosphere_height, MIN_ATMOSPHERE_HEIGHT, MAX_ATMOSPHERE_HEIGHT);
+        u[4] = unit(state.altitude, MIN_ALTITUDE, MAX_ALTITUDE);
+        u[5] = unit(state.noise_stdev, MIN_NOISE_STDEV, MAX_NOISE_STDEV);
+    }
+    return points;
+}
+
+// Worst box error over dimensions first to last - 1, with the other
+// dimensions left at their full range
+static double discrepancy(const std::vector<Point>& points, const std::vector<Point>& boxes,
+                          unsigned int first, unsigned int last)
+{
+    double worst = 0.0;
+    for (const Point& box : boxes)
+    {
+        double volume = 1.0;
+        for (unsigned int d = first; d < last; ++d)
+        {
+            volume *= box.u[d];
+        }
+
+        size_t inside = 0;
+        for (const Point& point : points)
+        {
+            unsigned int d = first;
+            while (d < last && point.u[d] < box.u[d])
+            {
+                ++d;
+            }
+            inside += d == last;
+        }
+        worst = std::max(worst, fabs((double)inside / points.size() - volume));
+    }
+    return worst;
+}
+
+int main(int argc, char** args)
+{
+    std::vector<unsigned int> counts;
+    for (int i = 1; i < argc; ++i)
+    {
+        int count = atoi(args[i]);
+        if (count <= 0)
+        {
+            cout << "Usage: ./sampler_check [count...]" << endl;
+            return 1;
+        }
+        counts.push_back(count);
+    }
+    if (counts.empty())
+    {
+        counts = {1000, 10000, 100000};
+    }
+
+    std::mt19937 random_engine(1);
+    std::uniform_real_distribution<float> box_dist(0.0f, 1.0f);
+    std::vector<Point> boxes(BOX_COUNT);
+    for (Point& box : boxes)
+    {
+        for (float& u : box.u)
+        {
+            u = box_dist(random_engine);
+        }
+    }
+
+    static const char* const SAMPLER_NAMES[] = {"random", "sobol", "halton", "stratified"};
+
+    cout << "Star discrepancy (lower is more even) over orientation, ranges"
+         << " (atmosphere_height, altitude, noise_stdev) and all six together" << endl;
+    for (unsigned int count : counts)
+    {
+        for (int sampler = SAMPLER_RANDOM; sampler <= SAMPLER_STRATIFIED; ++sampler)
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<Point> points = sample((Sampler)sampler, count);
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+            cout << SAMPLER_NAMES[sampler] << " x " << count
+                 << ": orientation " << discrepancy(points, boxes, 0, ORIENTATION_DIMENSIONS)
+                 << ", ranges " << discrepancy(points, boxes, ORIENTATION_DIMENSIONS, DIMENSIONS)
+                 << ", all " << discrepancy(points, boxes, 0, DIMENSIONS)
+                 << " (sampled in " << seconds.count() * 1e3 << " ms)" << endl;
+        }
+    }
+    return 0;
+}
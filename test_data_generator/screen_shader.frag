@@ -1,50 +1,146 @@
-#version 330 
+#version 400 core
 
 out vec4 Color;
 
-uniform vec3 nadir;
 uniform uint screen_width;
 uniform uint screen_height;
-uniform float alpha;
-uniform float alpha_atmosphere;
 
-// Distortion coeffs
-uniform float K1;
-uniform float K2;
+// Per-sample parameters, from the Samples block in screen_shader.vert
+flat in vec3 nadir;
+flat in float alpha;
+flat in float alpha_atmosphere;
 
-uniform sampler2D noise_texture;
+// Unit ray through each pixel with the lens distortion applied, from a
+// DistortionTable (see distortion.h)
+uniform sampler2D distortion_rays;
 
-in vec2 tex_coord;
+// Sensor noise
+flat in uint noise_seed;
+flat in float noise_stdev;
 
-void main()
+// The noise has one sample per camera pixel, however big the screen is
+uniform uint camera_width;
+uniform uint camera_height;
+
+flat in vec2 tile_origin;
+
+// The noise below is the same generator as noise_fill in noise.cpp (see
+// noise.h), operation for operation, so the CPU renderer can match it. Change
+// both together.
+
+uvec4 philox(uint block, uint seed)
 {
-    // Width of the image plane, for z = -1, assuming FOV of 57 degrees
-    const float width = 1.0859114f;
-    float height = width * screen_height / screen_width;
+    uvec4 c = uvec4(block, 0u, 0u, 0u);
+    uvec2 k = uvec2(seed, 0u);
+    for (int round = 0; round < 10; ++round)
+    {
+        uint hi0, lo0, hi1, lo1;
+        umulExtended(0xD2511F53u, c.x, hi0, lo0);
+        umulExtended(0xCD9E8D57u, c.z, hi1, lo1);
+        c = uvec4(hi1 ^ c.y ^ k.x, lo1, hi0 ^ c.w ^ k.y, lo0);
+        k += uvec2(0x9E3779B9u, 0xBB67AE85u);
+    }
+    return c;
+}
 
-    vec2 frag_coord_centred = gl_FragCoord.xy - 0.5f*vec2(screen_width, screen_height);
+// sqrt(-2 ln u) with u taken from the top 24 bits of `bits`, using the Cephes
+// logf polynomial
+float box_muller_radius(uint bits)
+{
+    precise float u = float((bits >> 8) | 1u) * (1.0f / 16777216.0f);
 
-    // Add lens distortion to frag coord
+    uint u_bits = floatBitsToUint(u);
+    precise float e = float(int(u_bits >> 23) - 126);
+    precise float m = uintBitsToFloat((u_bits & 0x807FFFFFu) | 0x3F000000u);
+    if (m < 0.707106781186547524f)
     {
-        float r_sq = frag_coord_centred.x*frag_coord_centred.x
-            + frag_coord_centred.y*frag_coord_centred.y;
+        e = e - 1.0f;
+        m = m + m;
+    }
+    m = m - 1.0f;
+
+    precise float z = m * m;
+    precise float y = 7.0376836292e-2f;
+    y = y * m - 1.1514610310e-1f;
+    y = y * m + 1.1676998740e-1f;
+    y = y * m - 1.2420140846e-1f;
+    y = y * m + 1.4249322787e-1f;
+    y = y * m - 1.6668057665e-1f;
+    y = y * m + 2.0000714765e-1f;
+    y = y * m - 2.4999993993e-1f;
+    y = y * m + 3.3333331174e-1f;
+    y = y * m * z;
+    y = y + e * -2.12194440e-4f;
+    y = y - 0.5f * z;
+    precise float log_u = m + y;
+    log_u = log_u + e * 0.693359375f;
 
-        float screen_radius_sq = 0.25f * (screen_width*screen_width + screen_height*screen_height);
+    return sqrt(-2.0f * log_u);
+}
+
+// (cos, sin) of a uniform angle taken from `bits`. The top two bits pick the
+// quadrant.
+vec2 box_muller_angle(uint bits)
+{
+    int fraction = int((bits >> 8) & 0x3FFFFFu);
+    precise float a = float(2 * fraction - 0x3FFFFF) * (1.5707963267948966f / 8388608.0f);
+    precise float z = a * a;
 
-        frag_coord_centred *= 1.0f + (K1*r_sq + K2*r_sq*r_sq) / screen_radius_sq;
+    precise float s = -1.9515295891e-4f;
+    s = s * z + 8.3321608736e-3f;
+    s = s * z - 1.6666654611e-1f;
+    s = s * z * a + a;
+
+    precise float c = 2.443315711809948e-5f;
+    c = c * z - 1.388731625493765e-3f;
+    c = c * z + 4.166664568298827e-2f;
+    c = c * z * z - 0.5f * z + 1.0f;
+
+    switch (bits >> 30)
+    {
+        case 0u: return vec2(c, s);
+        case 1u: return vec2(-s, c);
+        case 2u: return vec2(-c, -s);
+        default: return vec2(s, -c);
     }
+}
+
+float noise(vec2 frag_coord)
+{
+    uvec2 pixel = min(uvec2(frag_coord * vec2(camera_width, camera_height) / vec2(screen_width, screen_height)), uvec2(camera_width - 1u, camera_height - 1u));
+    uint i = pixel.y * camera_width + pixel.x;
+
+    // Element i is lane i % 4 of Philox block i / 4. Lanes 0 and 1 are the
+    // cos and sin halves of the first Box-Muller pair, 2 and 3 of the second.
+    uvec4 bits = philox(i / 4u, noise_seed);
+    uint lane = i % 4u;
+    uvec2 pair = lane < 2u ? bits.xy : bits.zw;
+
+    precise float r = box_muller_radius(pair.x) * noise_stdev;
+    vec2 cos_sin = box_muller_angle(pair.y);
+    return r * ((lane & 1u) == 0u ? cos_sin.x : cos_sin.y);
+}
+
+void main()
+{
+    // Position within this sample's tile
+    vec2 frag_coord = gl_FragCoord.xy - tile_origin;
 
-    vec3 dir = vec3(frag_coord_centred * (width / screen_width), -1.0f);
+    // Same operations in the same order as cpu_renderer.cpp, so both see the
+    // same edges
+    vec3 ray = texelFetch(distortion_rays, ivec2(frag_coord), 0).xyz;
+    precise float d = nadir.x*ray.x + nadir.y*ray.y;
+    d = d + nadir.z*ray.z;
 
     vec3 color = vec3(0.0f, 0.0f, 0.0f);
-    if (dot(nadir, normalize(dir)) > alpha)
+    if (d > alpha)
     {
         color = vec3(0.5f, 0.5f, 0.5f);
     }
-    else if (dot(nadir, normalize(dir)) > alpha_atmosphere)
+    else if (d > alpha_atmosphere)
     {
-        color = ((dot(nadir, normalize(dir)) - alpha_atmosphere) / (alpha - alpha_atmosphere)) * vec3(0.5f, 0.5f, 0.5f);
+        color = ((d - alpha_atmosphere) / (alpha - alpha_atmosphere)) * vec3(0.5f, 0.5f, 0.5f);
     }
 
-    Color = vec4(color + texture(noise_texture, tex_coord).r * vec3(1.0f, 1.0f, 1.0f), 1.0f);
+    Color = vec4(color + noise(frag_coord) * vec3(1.0f, 1.0f, 1.0f), 1.0f);
 }
@@ -1,12 +1,57 @@
 #version 330 core
 
 layout (location = 0) in vec3 position;
-layout (location = 1) in vec2 tex_coord_in;
 
-out vec2 tex_coord;
+// Everything that changes from sample to sample, one entry per instance. The
+// layout matches SampleUniforms in rendering.cpp.
+#define MAX_SAMPLES 256
+
+struct Sample
+{
+    vec3 nadir;
+    float alpha;
+    float alpha_atmosphere;
+    float noise_stdev;
+    uint noise_seed;
+};
+
+layout (std140) uniform Samples
+{
+    Sample samples[MAX_SAMPLES];
+};
+
+// Instance i is drawn into tile i of an atlas with atlas_columns tiles per
+// row, each screen_width by screen_height pixels. A single frame is instance
+// 0 of a one-tile atlas. Samples with different lenses are drawn separately,
+// starting at instance_offset.
+uniform uint instance_offset;
+uniform uint atlas_columns;
+uniform uint atlas_rows;
+uniform uint screen_width;
+uniform uint screen_height;
+
+flat out vec2 tile_origin;
+
+// The sample's parameters are passed on to every fragment of its tile
+flat out vec3 nadir;
+flat out float alpha;
+flat out float alpha_atmosphere;
+flat out uint noise_seed;
+flat out float noise_stdev;
 
 void main()
 {
-    gl_Position = vec4(position, 1.0f);
-    tex_coord = tex_coord_in;
+    uint instance = uint(gl_InstanceID) + instance_offset;
+    uvec2 tile = uvec2(instance % atlas_columns, instance / atlas_columns);
+    vec2 tile_position = (position.xy * 0.5f + 0.5f + vec2(tile)) / vec2(atlas_columns, atlas_rows);
+
+    gl_Position = vec4(tile_position * 2.0f - 1.0f, position.z, 1.0f);
+    tile_origin = vec2(tile) * vec2(screen_width, screen_height);
+
+    Sample params = samples[instance];
+    nadir = params.nadir;
+    alpha = params.alpha;
+    alpha_atmosphere = params.alpha_atmosphere;
+    noise_seed = params.noise_seed;
+    noise_stdev = params.noise_stdev;
 }
@@ -0,0 +1,38 @@
+#include "sensor.h"
+
+#include <cstring>
+
+// The Lepton is what flies. The bigger ones keep its field of view and lens,
+// so only the resolution changes when comparing them.
+const SensorProfile SENSOR_PROFILES[] = {
+    {"lepton3.5", LEPTON_WIDTH, LEPTON_HEIGHT, LEPTON_HORIZONTAL_FOV, LEPTON_BIT_DEPTH, DEFAULT_LENS_DIST, DEFAULT_LENS_DIST},
+    {"320x240", 320, 240, LEPTON_HORIZONTAL_FOV, LEPTON_BIT_DEPTH, DEFAULT_LENS_DIST, DEFAULT_LENS_DIST},
+    {"640x480", 640, 480, LEPTON_HORIZONTAL_FOV, LEPTON_BIT_DEPTH, DEFAULT_LENS_DIST, DEFAULT_LENS_DIST},
+    {"1024x768", 1024, 768, LEPTON_HORIZONTAL_FOV, 16, DEFAULT_LENS_DIST, DEFAULT_LENS_DIST},
+};
+
+const unsigned int SENSOR_PROFILE_COUNT = sizeof(SENSOR_PROFILES) / sizeof(*SENSOR_PROFILES);
+
+const SensorProfile* find_sensor_profile(const char* name)
+{
+    for (unsigned int i = 0; i < SENSOR_PROFILE_COUNT; ++i)
+    {
+        if (strcmp(SENSOR_PROFILES[i].name, name) == 0)
+        {
+            return &SENSOR_PROFILES[i];
+        }
+    }
+    return nullptr;
+}
+
+void apply_sensor_profile(SimulationState* state, const SensorProfile& profile)
+{
+    memset(state->sensor_name, 0, sizeof(state->sensor_name));
+    strncpy(state->sensor_name, profile.name, sizeof(state->sensor_name) - 1);
+    state->sensor_width = profile.width;
+    state->sensor_height = profile.height;
+    state->horizontal_fov = profile.horizontal_fov;
+    state->bit_depth = profile.bit_depth;
+    state->K1 = profile.K1;
+    state->K2 = profile.K2;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "sim.h"
+
+#include <stdint.h>
+
+// Sensor profiles (--sensor)
+//
+// The resolution, field of view, output bit depth and lens distortion frames
+// are rendered with. The chosen profile is copied into every sample's
+// SimulationState, so it ends up in the .hrz files and datasets alongside the
+// frames, and everything downstream sizes its buffers from there.
+struct SensorProfile
+{
+    const char* name;
+    uint32_t width;
+    uint32_t height;
+    float horizontal_fov;   // degrees
+    uint32_t bit_depth;     // of the .bin pixels, at most 16
+    float K1;
+    float K2;
+};
+
+extern const SensorProfile SENSOR_PROFILES[];
+extern const unsigned int SENSOR_PROFILE_COUNT;
+
+// The profile called `name`, or nullptr if there isn't one
+const SensorProfile* find_sensor_profile(const char* name);
+
+// Sets the sensor fields of `state`, including the distortion coefficients
+void apply_sensor_profile(SimulationState* state, const SensorProfile& profile);
+
+// Pixels in a frame from the sensor `state` was made for
+inline uint32_t sensor_pixels(const SimulationState& state)
+{
+    return state.sensor_width * state.sensor_height;
+}
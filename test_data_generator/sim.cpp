@@ -1,4 +1,5 @@
 #include "sim.h"
+#include <cstddef>
 #include <fstream>
 #include <iomanip>
 #include <string>
@@ -8,18 +9,33 @@
 bool SimulationState::load_state(const char* filename)
 {
     std::ifstream save_file(filename, std::ios::binary | std::ios::ate);
-    if (save_file.tellg() != sizeof(*this))
+    std::streamoff size = save_file.tellg();
+
+    // Older files stop before the sensor profile, which keeps its defaults
+    if (size != sizeof(*this) && size != offsetof(SimulationState, sensor_name))
     {
         std::cout << "Badly formatted save file" << std::endl;
         return false;
     }
+    SimulationState loaded;
     save_file.seekg(std::ios::beg);
-    save_file.read((char*)this, sizeof(*this));
+    save_file.read((char*)&loaded, size);
+
+    // The renderers divide by the resolution and shift by 16 - bit_depth, so
+    // a corrupt sensor profile is refused rather than rendered
+    if (!save_file || loaded.sensor_width == 0 || loaded.sensor_height == 0
+        || loaded.bit_depth < 1 || loaded.bit_depth > 16)
+    {
+        std::cout << "Badly formatted save file" << std::endl;
+        return false;
+    }
+    *this = loaded;
     return true;
 }
 
-void SimulationState::save_state(const char* filename)
+bool SimulationState::save_state(const char* filename) const
 {
     std::ofstream save_file(filename, std::ios::trunc | std::ios::binary);
     save_file.write((const char*)this, sizeof(*this));
+    return (bool)save_file;
 }
@@ -40,7 +40,16 @@ struct SimulationState
     float K1 = DEFAULT_LENS_DIST;
     float K2 = DEFAULT_LENS_DIST;
 
+    // Inputs: The sensor profile the frame is rendered for (see sensor.h).
+    // Files saved before these were added end at K2, and load as the Lepton.
+    char sensor_name[16] = "lepton3.5";
+    uint32_t sensor_width = LEPTON_WIDTH;
+    uint32_t sensor_height = LEPTON_HEIGHT;
+    float horizontal_fov = LEPTON_HORIZONTAL_FOV;   // degrees
+    uint32_t bit_depth = LEPTON_BIT_DEPTH;          // of the .bin pixels
+
     bool load_state(const char* filename);
-    void save_state(const char* filename);
+    // Returns false if the file couldn't be written
+    bool save_state(const char* filename) const;
 };
 #pragma pack(pop)
@@ -0,0 +1,66 @@
+#include "state_columns.h"
+
+#include <cstddef>
+#include <cstring>
+
+// Where each column's values come from in a SimulationState. Columns are
+// written in this order, after sample_index.
+struct StateColumn
+{
+    ColumnSpec spec;
+    size_t offset;
+};
+
+static const StateColumn STATE_COLUMNS[] = {
+    {{"camera", COLUMN_F32, 4}, offsetof(SimulationState, camera)},
+    {{"magnetometer_reference_frame", COLUMN_F32, 4}, offsetof(SimulationState, magnetometer_reference_frame)},
+    {{"altitude", COLUMN_F32, 1}, offsetof(SimulationState, altitude)},
+    {{"latitude", COLUMN_F32, 1}, offsetof(SimulationState, latitude)},
+    {{"longitude", COLUMN_F32, 1}, offsetof(SimulationState, longitude)},
+    {{"noise_seed", COLUMN_I32, 1}, offsetof(SimulationState, noise_seed)},
+    {{"noise_stdev", COLUMN_F32, 1}, offsetof(SimulationState, noise_stdev)},
+    {{"visible_atmosphere_height", COLUMN_F32, 1}, offsetof(SimulationState, visible_atmosphere_height)},
+    {{"nadir", COLUMN_F32, 3}, offsetof(SimulationState, nadir)},
+    {{"magnetic_field", COLUMN_F32, 3}, offsetof(SimulationState, magnetic_field)},
+    {{"magnetometer", COLUMN_I16, 3}, offsetof(SimulationState, magnetometer)},
+    {{"magnetometer_transformation", COLUMN_F32, 16}, offsetof(SimulationState, magnetometer_transformation)},
+    {{"mag_noise", COLUMN_F32, 3}, offsetof(SimulationState, mag_noise)},
+    {{"K1", COLUMN_F32, 1}, offsetof(SimulationState, K1)},
+    {{"K2", COLUMN_F32, 1}, offsetof(SimulationState, K2)},
+    {{"sensor_name", COLUMN_U8, sizeof(SimulationState::sensor_name)}, offsetof(SimulationState, sensor_name)},
+    {{"sensor_width", COLUMN_U32, 1}, offsetof(SimulationState, sensor_width)},
+    {{"sensor_height", COLUMN_U32, 1}, offsetof(SimulationState, sensor_height)},
+    {{"horizontal_fov", COLUMN_F32, 1}, offsetof(SimulationState, horizontal_fov)},
+    {{"bit_depth", COLUMN_U32, 1}, offsetof(SimulationState, bit_depth)},
+};
+
+static const uint32_t STATE_COLUMN_COUNT = sizeof(STATE_COLUMNS) / sizeof(*STATE_COLUMNS);
+
+int state_columns_create(ColumnsWriter* writer, const char* filename, uint64_t count)
+{
+    ColumnSpec specs[1 + STATE_COLUMN_COUNT];
+    specs[0] = {"sample_index", COLUMN_U64, 1};
+    for (uint32_t i = 0; i < STATE_COLUMN_COUNT; ++i)
+    {
+        specs[i + 1] = STATE_COLUMNS[i].spec;
+    }
+    return columns_create(writer, filename, STATE_COLUMNS_VERSION, specs, 1 + STATE_COLUMN_COUNT, count);
+}
+
+int state_columns_write(ColumnsWriter* writer, uint64_t slot, uint64_t sample_index, const SimulationState& state)
+{
+    // Every column has the same count, so the first tells if the slot exists
+    void* value = columns_value(writer, 0, slot);
+    if (!value)
+    {
+        return -1;
+    }
+    memcpy(value, &sample_index, sizeof(sample_index));
+    for (uint32_t i = 0; i < STATE_COLUMN_COUNT; ++i)
+    {
+        const ColumnSpec& spec = STATE_COLUMNS[i].spec;
+        memcpy(columns_value(writer, i + 1, slot), (const uint8_t*)&state + STATE_COLUMNS[i].offset,
+               spec.components * column_type_size(spec.type));
+    }
+    return 0;
+}
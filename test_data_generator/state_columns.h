@@ -0,0 +1,17 @@
+#pragma once
+
+#include "columns.h"
+#include "sim.h"
+
+// The generator's columns (see columns.h): one per SimulationState field,
+// plus the fuzz run sample index. Bump this when a column changes meaning
+// without changing type or shape.
+#define STATE_COLUMNS_VERSION 1
+
+// Creates a column file with room for `count` samples. Returns 0 on success.
+int state_columns_create(ColumnsWriter* writer, const char* filename, uint64_t count);
+
+// Writes one sample into `slot`. Slots can be written in any order and from
+// several threads at once.
+// Returns 0 on success.
+int state_columns_write(ColumnsWriter* writer, uint64_t slot, uint64_t sample_index, const SimulationState& state);
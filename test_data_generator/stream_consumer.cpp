@@ -0,0 +1,124 @@
+// Reads frames from a --stream ring (see frame_ring.h) until the generator is
+// done, and reports how fast they came and how many were dropped. Optionally
+// writes them into a .hrzpack, which comes out byte-identical to what --pack
+// would have made, so it doubles as a check of the ring.
+//
+// Usage: ./stream_consumer </name> [output.hrzpack]
+//
+// Start it once the generator has printed "Streaming to", and it unlinks the
+// ring when it's finished.
+
+#include "frame_ring.h"
+#include "dataset.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+// Give up if the generator goes quiet for this long
+static const int STREAM_TIMEOUT_MS = 10000;
+
+int main(int argc, char** args)
+{
+    if (argc < 2 || argc > 3)
+    {
+        cout << "Usage: ./stream_consumer </name> [output.hrzpack]" << endl;
+        return 1;
+    }
+    const char* name = args[1];
+    const char* pack_filename = argc > 2 ? args[2] : nullptr;
+
+    FrameRing ring;
+    if (frame_ring_open(&ring, name) != 0)
+    {
+        return 1;
+    }
+    const FrameRingHeader* header = ring.header;
+
+    DatasetWriter dataset;
+    if (pack_filename)
+    {
+        if (dataset_create(&dataset, pack_filename, header->frame_width, header->frame_height, header->state_size, header->sample_count) != 0)
+        {
+            return 1;
+        }
+    }
+
+    // Frames are copied out of the ring before they're known to be intact,
+    // and only written once the release says they are
+    std::vector<uint16_t> frame((size_t)header->frame_width * header->frame_height);
+    std::vector<uint8_t> state(header->state_size);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t received = 0;
+    uint64_t torn = 0;
+    while (true)
+    {
+        FrameRingSample sample;
+        int result = frame_ring_acquire(&ring, &sample, STREAM_TIMEOUT_MS);
+        if (result == 0)
+        {
+            break;
+        }
+        if (result < 0)
+        {
+            cerr << "Nothing from the generator for " << STREAM_TIMEOUT_MS / 1000 << " s, giving up" << endl;
+            return 1;
+        }
+
+        // A dropping ring can overwrite the slot while it's being copied, so
+        // the copy only counts if the release says the frame is intact
+        if (pack_filename)
+        {
+            memcpy(frame.data(), sample.frame, frame.size() * sizeof(uint16_t));
+            memcpy(state.data(), sample.state, state.size());
+        }
+
+        if (frame_ring_release(&ring) != 0)
+        {
+            ++torn;
+            continue;
+        }
+        ++received;
+
+        // A failed write is remembered by the writer, and the frames keep
+        // being drained so the generator isn't left waiting on the ring
+        if (pack_filename)
+        {
+            uint64_t slot = (sample.sample_index - header->sample_first) / header->sample_stride;
+            dataset_write(&dataset, slot, sample.sample_index, frame.data(), state.data());
+        }
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    cout << "Received " << received << " of " << header->sample_count << " frames in " << seconds.count() << " s ("
+         << received / seconds.count() << " frames/s)" << endl;
+    cout << "Dropped " << ring.dropped << " frames here (" << torn << " overwritten while being read), the generator dropped "
+         << header->dropped << " and waited for the ring " << header->full_waits << " times ("
+         << header->full_wait_ns / 1e6 << " ms)" << endl;
+
+    // A pack with holes is left without its complete flag, so readers
+    // refuse it the same as an interrupted one
+    int status = 0;
+    if (pack_filename)
+    {
+        if (received != header->sample_count)
+        {
+            cerr << "Not every frame arrived, " << pack_filename << " is incomplete" << endl;
+            dataset_fail(&dataset);
+        }
+        if (dataset_finish(&dataset) != 0)
+        {
+            status = 1;
+        }
+    }
+
+    frame_ring_close(&ring);
+    frame_ring_unlink(name);
+    return status;
+}
@@ -0,0 +1,147 @@
+#include "trajectory.h"
+
+#include <cmath>
+#include <random>
+
+static const double DEGREES = M_PI / 180.0;
+
+// Rotation of `angle` radians about `axis`, which doesn't have to be normalized
+static Quaternion axis_angle(double x, double y, double z, double angle)
+{
+    double length = sqrt(x*x + y*y + z*z);
+    if (length == 0.0)
+    {
+        return Quaternion();
+    }
+
+    double half = 0.5 * fmod(angle, 4.0 * M_PI);
+    double sine = sin(half) / length;
+
+    Quaternion result;
+    result.w = cos(half);
+    result.x = x * sine;
+    result.y = y * sine;
+    result.z = z * sine;
+    return result;
+}
+
+// Inertial from the local east, north, up frame that compute_outputs works
+// in, at a geocentric latitude and inertial longitude in radians
+static Quaternion local_frame(double latitude, double longitude)
+{
+    return Quaternion::roll(longitude + 0.5 * M_PI) * Quaternion::pitch(0.5 * M_PI - latitude);
+}
+
+static double wrap_angle(double angle)
+{
+    angle = fmod(angle + M_PI, 2.0 * M_PI);
+    if (angle < 0.0)
+    {
+        angle += 2.0 * M_PI;
+    }
+    return angle - M_PI;
+}
+
+bool trajectory_init(Trajectory* trajectory, const SimulationState& initial)
+{
+    double inclination = trajectory->inclination * DEGREES;
+    double latitude = initial.latitude * DEGREES;
+    double longitude = initial.longitude * DEGREES;
+
+    // Argument of latitude at the start, on the northbound pass
+    double sine_u = sin(inclination) != 0.0 ? sin(latitude) / sin(inclination) : 0.0;
+    if (fabs(sine_u) > 1.0 + 1e-9 || (sin(inclination) == 0.0 && latitude != 0.0))
+    {
+        return false;
+    }
+    double u = asin(fmax(-1.0, fmin(1.0, sine_u)));
+
+    // At time 0 the inertial frame lines up with the Earth-fixed one
+    trajectory->ascending_node = longitude - atan2(sin(u) * cos(inclination), cos(u));
+    trajectory->perigee_argument = u;
+
+    double perigee_radius = EARTH_RADIUS + initial.altitude;
+    trajectory->semi_major_axis = perigee_radius / (1.0 - trajectory->eccentricity);
+    trajectory->mean_motion = sqrt(EARTH_GRAVITATIONAL_PARAMETER / pow(trajectory->semi_major_axis, 3));
+
+    trajectory->initial_attitude = local_frame(latitude, longitude) * initial.camera;
+    trajectory->initial_attitude.normalize();
+    return true;
+}
+
+double trajectory_time(const Trajectory* trajectory, unsigned int frame)
+{
+    return frame / (double)trajectory->frame_rate;
+}
+
+void trajectory_state(SimulationState* state, const Trajectory* trajectory, const FuzzOptions* fuzz, unsigned int frame)
+{
+    double t = trajectory_time(trajectory, frame);
+    double e = trajectory->eccentricity;
+
+    // Kepler's equation, by Newton's method
+    double mean_anomaly = fmod(trajectory->mean_motion * t, 2.0 * M_PI);
+    double eccentric_anomaly = e < 0.8 ? mean_anomaly : M_PI;
+    for (int i = 0; i < 16; ++i)
+    {
+        double step = (eccentric_anomaly - e * sin(eccentric_anomaly) - mean_anomaly) / (1.0 - e * cos(eccentric_anomaly));
+        eccentric_anomaly -= step;
+        if (fabs(step) < 1e-12)
+        {
+            break;
+        }
+    }
+    double true_anomaly = 2.0 * atan2(sqrt(1.0 + e) * sin(0.5 * eccentric_anomaly), sqrt(1.0 - e) * cos(0.5 * eccentric_anomaly));
+    double radius = trajectory->semi_major_axis * (1.0 - e * cos(eccentric_anomaly));
+
+    // Inertial position
+    double u = trajectory->perigee_argument + true_anomaly;
+    double node = trajectory->ascending_node;
+    double inclination = trajectory->inclination * DEGREES;
+    double x = radius * (cos(node) * cos(u) - sin(node) * sin(u) * cos(inclination));
+    double y = radius * (sin(node) * cos(u) + cos(node) * sin(u) * cos(inclination));
+    double z = radius * sin(u) * sin(inclination);
+
+    double latitude = asin(z / radius);
+    double inertial_longitude = atan2(y, x);
+    double longitude = wrap_angle(inertial_longitude - fmod(EARTH_ROTATION_RATE * t, 2.0 * M_PI));
+
+    state->altitude = radius - EARTH_RADIUS;
+    state->latitude = latitude / DEGREES;
+    state->longitude = longitude / DEGREES;
+
+    std::seed_seq seed{fuzz->seed, frame};
+    std::mt19937 random_engine(seed);
+
+    // Drawn either way, so the jitter doesn't depend on which noise is
+    // fuzzed. Kept positive, like rand() used to.
+    int noise_seed = random_engine() >> 1;
+    if (fuzz->noise_seed)
+    {
+        state->noise_seed = noise_seed;
+    }
+
+    const Vec3& rates = trajectory->body_rates;
+    double rate = sqrt(rates.x * rates.x + rates.y * rates.y + rates.z * rates.z) * DEGREES;
+    Quaternion attitude = trajectory->initial_attitude * axis_angle(rates.x, rates.y, rates.z, rate * t);
+
+    if (trajectory->jitter > 0.0f)
+    {
+        std::normal_distribution<double> jitter_dist(0.0, trajectory->jitter * DEGREES);
+        double jx = jitter_dist(random_engine);
+        double jy = jitter_dist(random_engine);
+        double jz = jitter_dist(random_engine);
+        attitude = attitude * axis_angle(jx, jy, jz, sqrt(jx*jx + jy*jy + jz*jz));
+    }
+
+    state->camera = local_frame(latitude, inertial_longitude).inverse() * attitude;
+    state->camera.normalize();
+
+    if (fuzz->mag_reading)
+    {
+        std::normal_distribution<float> mag_dist(0.0f, fuzz->mag_stdev);
+        state->mag_noise.x = mag_dist(random_engine);
+        state->mag_noise.y = mag_dist(random_engine);
+        state->mag_noise.z = mag_dist(random_engine);
+    }
+}
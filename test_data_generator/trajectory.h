@@ -0,0 +1,54 @@
+#pragma once
+
+#include "sim.h"
+#include "fuzz.h"
+
+// Orbit sequences (--trajectory)
+//
+// Instead of independent random samples, sample N is the frame taken
+// N / frame_rate seconds into a Keplerian orbit, so consecutive samples form
+// a sequence a tracking detector can follow. The orbit starts at the
+// latitude, longitude and altitude of the loaded state, heading north, with
+// perigee there. The camera starts in the loaded orientation and turns at
+// constant body rates relative to inertial space, plus optional per-frame
+// jitter. Earth turns underneath, but there is no J2 or drag.
+//
+// Everything is a closed-form function of the frame number, so trajectories
+// split across --jobs and --shard like fuzz runs do.
+struct Trajectory
+{
+    // Number of frames, 0 unless --trajectory is given
+    unsigned int frames = 0;
+    float frame_rate = LEPTON_FRAME_RATE;
+
+    // Degrees
+    float inclination = DEFAULT_INCLINATION;
+    float eccentricity = 0.0f;
+
+    // Degrees per second about the camera's own axes
+    Vec3 body_rates;
+
+    // Standard deviation of each axis of a random rotation applied to every
+    // frame, in degrees
+    float jitter = 0.0f;
+
+    // Filled in by trajectory_init
+    double semi_major_axis = 0.0;     // km
+    double mean_motion = 0.0;         // rad/s
+    double ascending_node = 0.0;      // rad
+    double perigee_argument = 0.0;
+    Quaternion initial_attitude;    // inertial from camera
+};
+
+// Works out the orbit that starts at `initial`. Returns false if the orbit's
+// inclination doesn't reach the starting latitude.
+bool trajectory_init(Trajectory* trajectory, const SimulationState& initial);
+
+// Seconds from the start of the trajectory to a frame
+double trajectory_time(const Trajectory* trajectory, unsigned int frame);
+
+// Sets the position and orientation of `state` for a frame. With
+// fuzz->noise_seed and fuzz->mag_reading, the same as in a fuzz run, each frame
+// also gets its own image noise seed and magnetometer noise, drawn from the
+// fuzz seed and the frame number. Otherwise the loaded state's are kept.
+void trajectory_state(SimulationState* state, const Trajectory* trajectory, const FuzzOptions* fuzz, unsigned int frame);
@@ -0,0 +1,75 @@
+#include "window.h"
+
+#include "SDL/SDL.h"
+
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+
+bool window_init(RenderState* render_state, unsigned int screen_width, unsigned int screen_height, uint32_t camera_width, uint32_t camera_height)
+{
+    *render_state = RenderState();
+    render_state->renderer = RENDERER_GL;
+    render_state->camera_width = camera_width;
+    render_state->camera_height = camera_height;
+
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    {
+        cerr << "Error initializing SDL: " << SDL_GetError() << endl;
+        return false;
+    }
+
+    SDL_Window* window = SDL_CreateWindow(
+        "ECE 499 Test Image Generator",
+        SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+        screen_width, screen_height,
+        SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if (!window)
+    {
+        cerr << "Error creating window: " << SDL_GetError() << endl;
+        SDL_Quit();
+        return false;
+    }
+    render_state->window = window;
+
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+    render_state->gl_ctxt = SDL_GL_CreateContext(window);
+    if (!render_state->gl_ctxt)
+    {
+        cerr << "Error creating GL 4.2 context: " << SDL_GetError() << endl;
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return false;
+    }
+
+    // Enable VSync
+    if (SDL_GL_SetSwapInterval(1) < 0)
+    {
+        cerr << "Error enabling vsync" << endl;
+    }
+
+    // load gl bindings
+    GLenum err = glewInit();
+    if (err != GLEW_OK)
+    {
+        cerr << "Error loading gl bindings: "
+             << glewGetErrorString(err) << endl;
+    }
+
+    if (!render_init_context(render_state))
+    {
+        window_cleanup(render_state);
+        return false;
+    }
+    return true;
+}
+
+void window_cleanup(RenderState* render_state)
+{
+    render_cleanup(render_state);
+    SDL_GL_DeleteContext(render_state->gl_ctxt);
+    SDL_DestroyWindow((SDL_Window*)render_state->window);
+    SDL_Quit();
+}
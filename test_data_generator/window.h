@@ -0,0 +1,16 @@
+#pragma once
+
+#include "rendering.h"
+
+// The SDL window for the GUI and the gl renderer. Everything else renders
+// without one through render_open, so only the programs that use these need
+// SDL.
+
+// Creates a hidden screen_width x screen_height window with a GL 4.2 context,
+// current on the calling thread, and sets the gl renderer up in it for frames
+// of camera_width x camera_height. Returns false, having printed why, if it
+// can't.
+bool window_init(RenderState* render_state, unsigned int screen_width, unsigned int screen_height, uint32_t camera_width, uint32_t camera_height);
+
+// render_cleanup, then closes the window
+void window_cleanup(RenderState* render_state);
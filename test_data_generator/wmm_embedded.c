@@ -0,0 +1,62 @@
+// Before the WMM header, which defines _POSIX_C_SOURCE without a value
+#include <string.h>
+
+#include "wmm_embedded.h"
+
+typedef struct
+{
+    int n;
+    int m;
+    double g;
+    double h;
+    double secular_g;
+    double secular_h;
+} WmmCoefficient;
+
+#include "wmm_coefficients.h"
+
+MAGtype_MagneticModel* wmm_embedded_model(void)
+{
+    const size_t count = sizeof(wmm_embedded_coefficients) / sizeof(*wmm_embedded_coefficients);
+
+    int n_max = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (wmm_embedded_coefficients[i].n > n_max)
+        {
+            n_max = wmm_embedded_coefficients[i].n;
+        }
+    }
+
+    MAGtype_MagneticModel* model = MAG_AllocateModelMemory(CALCULATE_NUMTERMS(n_max));
+    if (!model)
+    {
+        return NULL;
+    }
+
+    // Same fields as MAG_robustReadMagModels and MAG_readMagneticModel set
+    model->nMax = n_max;
+    model->nMaxSecVar = n_max;
+    model->epoch = WMM_EMBEDDED_EPOCH;
+    model->CoefficientFileEndDate = WMM_EMBEDDED_EPOCH + 5;
+    strncpy(model->ModelName, WMM_EMBEDDED_NAME, sizeof(model->ModelName) - 1);
+
+    model->Main_Field_Coeff_G[0] = 0.0;
+    model->Main_Field_Coeff_H[0] = 0.0;
+    model->Secular_Var_Coeff_G[0] = 0.0;
+    model->Secular_Var_Coeff_H[0] = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const WmmCoefficient* c = &wmm_embedded_coefficients[i];
+        if (c->m <= c->n)
+        {
+            int index = c->n * (c->n + 1) / 2 + c->m;
+            model->Main_Field_Coeff_G[index] = c->g;
+            model->Main_Field_Coeff_H[index] = c->h;
+            model->Secular_Var_Coeff_G[index] = c->secular_g;
+            model->Secular_Var_Coeff_H[index] = c->secular_h;
+        }
+    }
+
+    return model;
+}
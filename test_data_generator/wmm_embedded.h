@@ -0,0 +1,24 @@
+#ifndef WMM_EMBEDDED_H
+#define WMM_EMBEDDED_H
+
+// WMM coefficients compiled into the program
+//
+// The Makefile turns WMM_2020/WMM.COF into a table (wmm_coefficients.h), so
+// the model is available without reading any files and no matter what
+// directory the program runs from.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "WMM_2020/GeomagnetismHeader.h"
+
+// Builds the same model MAG_robustReadMagModels reads from WMM.COF.
+// Free it with MAG_FreeMagneticModelMemory. Returns NULL if out of memory.
+MAGtype_MagneticModel* wmm_embedded_model(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // include guard
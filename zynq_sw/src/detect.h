@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2020 Ryan Blais, Hugo Burd, Byron Kontou, and Jeff Stacey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef DETECT_HEADER
+#define DETECT_HEADER
+
+#include <stdint.h>
+#include "edge.h"
+#include "linalg.h"
+
+/*
+ * The horizon detection pipeline, on the globals below.
+ *
+ * main fills in the inputs and calls detect_horizon once per frame. A host
+ * build (the test image generator's GUI) links this file and the stages it
+ * calls without main.c, and runs it on frames as it renders them.
+ */
+
+// The parts of the pipeline timed separately, in order
+typedef enum {
+    DETECT_BLUR,            // gaussian blur
+    DETECT_GRADIENT,        // x and y convolutions, magnitude and direction
+    DETECT_SUPPRESSION,     // non-max suppression
+    DETECT_THRESHOLD,       // double threshold and edge tracking
+    DETECT_EDGE_POINTS,     // edge image to a list of points
+    DETECT_DISTORTION,      // barrel distortion correction of the points
+    DETECT_FIT,             // circle fit
+    DETECT_ATTITUDE,        // nadir and orientation from the circle
+    DETECT_STAGE_COUNT
+} DetectStage;
+
+extern const char* const detect_stage_names[DETECT_STAGE_COUNT];
+
+// get_ccount counts taken by each stage on the last run, 0 for stages that
+// were skipped
+extern uint32_t stage_cycles[DETECT_STAGE_COUNT];
+
+// Inputs
+extern pixel TestImg[R_DIM][C_DIM];
+extern int16_t magnetometer_reading[3];
+extern float magnetometer_transformation[16];
+extern float altitude;
+
+// Parameters
+extern int alg_choice;
+extern int min_required_points;
+extern float min_circle_radius;
+extern int correct_barrel_dist;
+
+// Intermediate products worth looking at
+extern pixel suppressed[R_DIM][C_DIM];
+extern uint16_t num_points;
+extern Vec2D edge_points[R_DIM*C_DIM];   // distortion corrected after DETECT_DISTORTION
+extern float circ_params[3];
+
+// Results
+extern int reject;
+extern float nadir[3];
+extern Quaternion orientation;
+
+// Runs the pipeline on TestImg, setting the results
+void detect_horizon(void);
+
+#endif
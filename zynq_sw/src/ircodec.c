@@ -0,0 +1,305 @@
+/*
+Copyright (c) 2020 Ryan Blais, Hugo Burd, Byron Kontou, and Jeff Stacey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ircodec.h"
+
+#include <string.h>
+
+/* Models forget half of what they've seen every this many residuals */
+#define IRC_RESET 64
+
+typedef struct
+{
+    uint8_t* out;
+    size_t capacity;
+    size_t position;
+    uint64_t bits;
+    unsigned int bit_count;
+    int overflow;
+} BitWriter;
+
+static void model_init(IrcModel* model)
+{
+    for (int i = 0; i < IRC_CONTEXTS; i++) {
+        model->sum[i] = 4;
+        model->count[i] = 1;
+    }
+}
+
+/*
+ * Works out the prediction for a pixel from its neighbours, and which
+ * context codes its residual
+ */
+static inline uint32_t predict(uint32_t a, uint32_t b, uint32_t c, unsigned int* context)
+{
+    /* Contexts go up with the bit length of the activity */
+    uint32_t activity = (a > c ? a - c : c - a) + (b > c ? b - c : c - b);
+    unsigned int bucket = activity ? 32 - __builtin_clz(activity) : 0;
+    *context = bucket < IRC_CONTEXTS ? bucket : IRC_CONTEXTS - 1;
+
+    uint32_t lo = a < b ? a : b;
+    uint32_t hi = a < b ? b : a;
+    if (c >= hi) {
+        return lo;
+    } else if (c <= lo) {
+        return hi;
+    }
+    return a + b - c;
+}
+
+/* Neighbours of pixel x of a row, for the first row when above is NULL */
+static inline void neighbours(const uint16_t* above, const uint16_t* row, uint32_t x, uint32_t first,
+                              uint32_t* a, uint32_t* b, uint32_t* c)
+{
+    if (!above) {
+        *a = x ? row[x - 1] : first;
+        *b = *a;
+        *c = *a;
+    } else if (x == 0) {
+        *b = above[0];
+        *a = *b;
+        *c = *b;
+    } else {
+        *a = row[x - 1];
+        *b = above[x];
+        *c = above[x - 1];
+    }
+}
+
+/*
+ * The smallest k with count << k >= sum. With both as bit lengths that's
+ * either their difference or one more.
+ */
+static inline unsigned int rice_parameter(const IrcModel* model, unsigned int context, unsigned int max_k)
+{
+    uint32_t sum = model->sum[context];
+    uint32_t count = model->count[context];
+    if (sum <= count) {
+        return 0;
+    }
+    unsigned int k = (32 - __builtin_clz(sum)) - (32 - __builtin_clz(count));
+    if ((count << k) < sum) {
+        k++;
+    }
+    return k < max_k ? k : max_k;
+}
+
+static inline void model_update(IrcModel* model, unsigned int context, uint32_t mapped)
+{
+    model->sum[context] += mapped;
+    if (++model->count[context] == IRC_RESET) {
+        model->sum[context] >>= 1;
+        model->count[context] >>= 1;
+    }
+}
+
+static inline void put_bits(BitWriter* writer, uint32_t value, unsigned int count)
+{
+    writer->bits |= (uint64_t)value << writer->bit_count;
+    writer->bit_count += count;
+    if (writer->bit_count >= 32) {
+        if (writer->position + 4 > writer->capacity) {
+            writer->overflow = 1;
+        } else {
+            uint32_t word = (uint32_t)writer->bits;
+            memcpy(writer->out + writer->position, &word, 4);
+            writer->position += 4;
+        }
+        writer->bits >>= 32;
+        writer->bit_count -= 32;
+    }
+}
+
+size_t irc_encode(const uint16_t* pixels, uint32_t width, uint32_t height, uint32_t bit_depth, uint8_t* out, size_t capacity)
+{
+    if (capacity < sizeof(IrcHeader) || width > 0xffff || height > 0xffff
+        || bit_depth == 0 || bit_depth > 16) {
+        return 0;
+    }
+
+    IrcHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IRC_MAGIC, sizeof(header.magic));
+    header.width = width;
+    header.height = height;
+    header.bit_depth = bit_depth;
+    memcpy(out, &header, sizeof(header));
+
+    BitWriter writer = {out, capacity, sizeof(header), 0, 0, 0};
+    IrcModel model;
+    model_init(&model);
+
+    uint32_t first = 1u << (bit_depth - 1);
+    uint32_t raw_bits = bit_depth + 1;
+    for (uint32_t y = 0; y < height; y++) {
+        const uint16_t* row = pixels + (size_t)y * width;
+        const uint16_t* above = y ? row - width : NULL;
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t a, b, c;
+            unsigned int context;
+            neighbours(above, row, x, first, &a, &b, &c);
+            int32_t residual = (int32_t)row[x] - (int32_t)predict(a, b, c, &context);
+            uint32_t mapped = residual >= 0 ? 2 * (uint32_t)residual : 2 * (uint32_t)(-residual) - 1;
+
+            unsigned int k = rice_parameter(&model, context, bit_depth);
+            uint32_t quotient = mapped >> k;
+            if (quotient < IRC_ESCAPE) {
+                /* quotient 0s, a 1, then the low k bits */
+                put_bits(&writer, 1u << quotient, quotient + 1);
+                put_bits(&writer, mapped & ((1u << k) - 1), k);
+            } else {
+                put_bits(&writer, 1u << IRC_ESCAPE, IRC_ESCAPE + 1);
+                put_bits(&writer, mapped, raw_bits);
+            }
+            model_update(&model, context, mapped);
+        }
+    }
+
+    /* Whatever's left of the last word */
+    size_t tail = (writer.bit_count + 7) / 8;
+    if (writer.overflow || writer.position + tail > capacity) {
+        return 0;
+    }
+    for (size_t i = 0; i < tail; i++) {
+        out[writer.position++] = (uint8_t)(writer.bits >> (8 * i));
+    }
+    return writer.position;
+}
+
+int irc_decoder_init(IrcDecoder* decoder, const uint8_t* data, size_t size)
+{
+    memset(decoder, 0, sizeof(*decoder));
+    if (size < sizeof(IrcHeader)) {
+        return -1;
+    }
+    memcpy(&decoder->header, data, sizeof(IrcHeader));
+    if (memcmp(decoder->header.magic, IRC_MAGIC, sizeof(decoder->header.magic)) != 0
+        || decoder->header.bit_depth == 0 || decoder->header.bit_depth > 16) {
+        return -1;
+    }
+
+    model_init(&decoder->model);
+    decoder->data = data;
+    decoder->size = size;
+    decoder->position = sizeof(IrcHeader);
+    return 0;
+}
+
+/* Tops the bit buffer up to at least 57 bits, with 0s past the end */
+static inline void refill(IrcDecoder* decoder)
+{
+    if (decoder->position + 8 <= decoder->size) {
+        /* Whole bytes that fit, in one load */
+        uint64_t word;
+        memcpy(&word, decoder->data + decoder->position, sizeof(word));
+        decoder->bits |= word << decoder->bit_count;
+        decoder->position += (63 - decoder->bit_count) >> 3;
+        decoder->bit_count |= 56;
+        return;
+    }
+    while (decoder->bit_count <= 56) {
+        uint64_t byte = decoder->position < decoder->size ? decoder->data[decoder->position] : 0;
+        decoder->position++;
+        decoder->bits |= byte << decoder->bit_count;
+        decoder->bit_count += 8;
+    }
+}
+
+static inline uint32_t take_bits(IrcDecoder* decoder, unsigned int count)
+{
+    uint32_t value = (uint32_t)(decoder->bits & ((1ull << count) - 1));
+    decoder->bits >>= count;
+    decoder->bit_count -= count;
+    return value;
+}
+
+int irc_decode_row(IrcDecoder* decoder, const uint16_t* above, uint16_t* row)
+{
+    const IrcHeader* header = &decoder->header;
+    if (decoder->row >= header->height) {
+        return -1;
+    }
+    if (decoder->row == 0) {
+        above = NULL;
+    }
+
+    uint32_t bit_depth = header->bit_depth;
+    uint32_t first = 1u << (bit_depth - 1);
+    uint32_t raw_bits = bit_depth + 1;
+    uint32_t max_value = (1u << bit_depth) - 1;
+    for (uint32_t x = 0; x < header->width; x++) {
+        uint32_t a, b, c;
+        unsigned int context;
+        neighbours(above, row, x, first, &a, &b, &c);
+        int32_t prediction = (int32_t)predict(a, b, c, &context);
+        unsigned int k = rice_parameter(&decoder->model, context, bit_depth);
+
+        /* At most IRC_ESCAPE + 1 + 17 bits per pixel, the refill covers it */
+        refill(decoder);
+        uint32_t low = (uint32_t)decoder->bits & ((1u << (IRC_ESCAPE + 1)) - 1);
+        if (!low) {
+            return -1;
+        }
+        unsigned int quotient = __builtin_ctz(low);
+        take_bits(decoder, quotient + 1);
+
+        uint32_t mapped;
+        if (quotient < IRC_ESCAPE) {
+            mapped = (quotient << k) | take_bits(decoder, k);
+        } else {
+            mapped = take_bits(decoder, raw_bits);
+        }
+
+        int32_t residual = (mapped & 1) ? -(int32_t)((mapped + 1) >> 1) : (int32_t)(mapped >> 1);
+        int32_t value = prediction + residual;
+        if (value < 0 || (uint32_t)value > max_value) {
+            return -1;
+        }
+        row[x] = (uint16_t)value;
+        model_update(&decoder->model, context, mapped);
+    }
+
+    /* Bits still buffered were read past the end if the stream was short */
+    if (decoder->position > decoder->size + decoder->bit_count / 8) {
+        return -1;
+    }
+
+    decoder->row++;
+    return 0;
+}
+
+int irc_decode(const uint8_t* data, size_t size, uint16_t* pixels)
+{
+    IrcDecoder decoder;
+    if (irc_decoder_init(&decoder, data, size) != 0) {
+        return -1;
+    }
+
+    uint32_t width = decoder.header.width;
+    for (uint32_t y = 0; y < decoder.header.height; y++) {
+        uint16_t* row = pixels + (size_t)y * width;
+        if (irc_decode_row(&decoder, y ? row - width : NULL, row) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
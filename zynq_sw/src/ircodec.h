@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2020 Ryan Blais, Hugo Burd, Byron Kontou, and Jeff Stacey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IRCODEC_HEADER
+#define IRCODEC_HEADER
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lossless IR frame codec (.irc files)
+ *
+ * Horizon frames are mostly flat sky and earth with one edge through them
+ * and some sensor noise, so each pixel is predicted from its neighbours with
+ * the LOCO-I median edge detector:
+ *
+ *     c b        prediction = min(a, b)   if c >= max(a, b)
+ *     a x                     max(a, b)   if c <= min(a, b)
+ *                             a + b - c   otherwise
+ *
+ * and the residual is Rice coded. The Rice parameter adapts to the recent
+ * residuals in one of IRC_CONTEXTS contexts, picked by how busy the
+ * neighbourhood is (|a - c| + |b - c|), so the flat regions and the edge
+ * each get their own. The first row is predicted from the left only, and the
+ * first pixel of every other row from the one above.
+ *
+ * A stream is an IrcHeader followed by the bits of every row in order, least
+ * significant bit first. Rows only depend on the row above, so a decoder can
+ * hand out rows as it goes without holding the whole frame.
+ */
+
+#define IRC_MAGIC "IRC1"
+#define IRC_CONTEXTS 16
+
+/* Unary parts this long are followed by the raw residual instead */
+#define IRC_ESCAPE 24
+
+#pragma pack(push, 1)
+typedef struct
+{
+    char magic[4];
+    uint16_t width;
+    uint16_t height;
+    uint8_t bit_depth;      /* of the pixels, at most 16 */
+    uint8_t reserved[3];
+} IrcHeader;
+#pragma pack(pop)
+
+/* Most bytes a frame of `count` pixels can take, however noisy */
+#define IRC_MAX_BYTES(count) (sizeof(IrcHeader) + ((size_t)(count) * (IRC_ESCAPE + 1 + 17) + 7) / 8 + 8)
+
+/* Adaptive Rice parameters, one set per context */
+typedef struct
+{
+    uint32_t sum[IRC_CONTEXTS];     /* of recent mapped residuals */
+    uint32_t count[IRC_CONTEXTS];
+} IrcModel;
+
+typedef struct
+{
+    IrcHeader header;
+    IrcModel model;
+
+    const uint8_t* data;
+    size_t size;
+    size_t position;    /* next byte to read into bits */
+    uint64_t bits;
+    unsigned int bit_count;
+    unsigned int row;
+} IrcDecoder;
+
+/*
+ * Compresses a width x height frame of bit_depth-bit pixels, top row first,
+ * into `out`. Returns the number of bytes written, or 0 if they didn't fit in
+ * `capacity` (IRC_MAX_BYTES always fits) or bit_depth isn't 1 to 16.
+ */
+size_t irc_encode(const uint16_t* pixels, uint32_t width, uint32_t height, uint32_t bit_depth, uint8_t* out, size_t capacity);
+
+/* Reads the header of a stream. Returns 0 on success. */
+int irc_decoder_init(IrcDecoder* decoder, const uint8_t* data, size_t size);
+
+/*
+ * Decodes the next row into `row`. `above` is the row decoded before it, and
+ * is ignored for the first row. Returns 0 on success, or -1 if the stream is
+ * corrupt or has no rows left.
+ */
+int irc_decode_row(IrcDecoder* decoder, const uint16_t* above, uint16_t* row);
+
+/* Decodes a whole frame, header.width * header.height pixels. Returns 0 on success. */
+int irc_decode(const uint8_t* data, size_t size, uint16_t* pixels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+/*
+Copyright (c) 2020 Ryan Blais, Hugo Burd, Byron Kontou, and Jeff Stacey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "pack14.h"
+
+#include <string.h>
+
+/*
+ * Only the host has a vector path. The detector runs on the Cortex-R5, which
+ * has no NEON, so it always takes the scalar loops below.
+ */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * In a 64-bit word holding 4 uint16 pixels, pixel k sits at bit 16k, and in a
+ * packed group at bit 14k. Going between the two is a shift of 2k bits for
+ * each pixel, masked so nothing spills into its neighbours. Both host and
+ * target are little-endian, so words load straight out of memory.
+ */
+#define PIXEL0_MASK 0x0000000000003fffULL
+#define PIXEL1_MASK 0x000000003fff0000ULL
+#define PIXEL2_MASK 0x00003fff00000000ULL
+#define PIXEL3_MASK 0x3fff000000000000ULL
+
+static inline uint64_t unpack_group(uint64_t group)
+{
+    return (group & PIXEL0_MASK)
+        | ((group << 2) & PIXEL1_MASK)
+        | ((group << 4) & PIXEL2_MASK)
+        | ((group << 6) & PIXEL3_MASK);
+}
+
+static inline uint64_t pack_group(uint64_t pixels)
+{
+    return (pixels & PIXEL0_MASK)
+        | ((pixels & PIXEL1_MASK) >> 2)
+        | ((pixels & PIXEL2_MASK) >> 4)
+        | ((pixels & PIXEL3_MASK) >> 6);
+}
+
+void pack14(const uint16_t* pixels, uint8_t* packed, size_t count)
+{
+    size_t groups = (count + 3) / 4;
+    size_t g = 0;
+
+    /*
+     * Each group is stored as a whole 64-bit word, and the byte past its end
+     * is overwritten by the next group. Only the last group, which may also
+     * be partial, has to be stored 7 bytes at a time.
+     */
+#if defined(__SSE2__)
+    const __m128i mask0 = _mm_set1_epi64x(PIXEL0_MASK);
+    const __m128i mask1 = _mm_set1_epi64x(PIXEL1_MASK);
+    const __m128i mask2 = _mm_set1_epi64x(PIXEL2_MASK);
+    const __m128i mask3 = _mm_set1_epi64x(PIXEL3_MASK);
+    for (; g + 3 <= groups; g += 2)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i*)(pixels + 4 * g));
+        __m128i out = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(in, mask0), _mm_srli_epi64(_mm_and_si128(in, mask1), 2)),
+            _mm_or_si128(_mm_srli_epi64(_mm_and_si128(in, mask2), 4), _mm_srli_epi64(_mm_and_si128(in, mask3), 6)));
+        _mm_storel_epi64((__m128i*)(packed + 7 * g), out);
+        _mm_storel_epi64((__m128i*)(packed + 7 * g + 7), _mm_unpackhi_epi64(out, out));
+    }
+#endif
+
+    for (; g + 1 < groups; ++g)
+    {
+        uint64_t in;
+        memcpy(&in, pixels + 4 * g, sizeof(in));
+        uint64_t out = pack_group(in);
+        memcpy(packed + 7 * g, &out, sizeof(out));
+    }
+
+    if (g < groups)
+    {
+        uint64_t in = 0;
+        memcpy(&in, pixels + 4 * g, (count - 4 * g) * sizeof(uint16_t));
+        uint64_t out = pack_group(in);
+        memcpy(packed + 7 * g, &out, 7);
+    }
+}
+
+void unpack14(const uint8_t* packed, uint16_t* pixels, size_t count)
+{
+    size_t groups = (count + 3) / 4;
+    size_t g = 0;
+
+    /* Groups are loaded as whole 64-bit words too, except the last one */
+#if defined(__SSE2__)
+    const __m128i mask0 = _mm_set1_epi64x(PIXEL0_MASK);
+    const __m128i mask1 = _mm_set1_epi64x(PIXEL1_MASK);
+    const __m128i mask2 = _mm_set1_epi64x(PIXEL2_MASK);
+    const __m128i mask3 = _mm_set1_epi64x(PIXEL3_MASK);
+    for (; g + 3 <= groups; g += 2)
+    {
+        __m128i in = _mm_unpacklo_epi64(
+            _mm_loadl_epi64((const __m128i*)(packed + 7 * g)),
+            _mm_loadl_epi64((const __m128i*)(packed + 7 * g + 7)));
+        __m128i out = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(in, mask0), _mm_and_si128(_mm_slli_epi64(in, 2), mask1)),
+            _mm_or_si128(_mm_and_si128(_mm_slli_epi64(in, 4), mask2), _mm_and_si128(_mm_slli_epi64(in, 6), mask3)));
+        _mm_storeu_si128((__m128i*)(pixels + 4 * g), out);
+    }
+#endif
+
+    for (; g + 1 < groups; ++g)
+    {
+        uint64_t in;
+        memcpy(&in, packed + 7 * g, sizeof(in));
+        uint64_t out = unpack_group(in);
+        memcpy(pixels + 4 * g, &out, sizeof(out));
+    }
+
+    if (g < groups)
+    {
+        uint64_t in = 0;
+        memcpy(&in, packed + 7 * g, 7);
+        uint64_t out = unpack_group(in);
+        memcpy(pixels + 4 * g, &out, (count - 4 * g) * sizeof(uint16_t));
+    }
+}
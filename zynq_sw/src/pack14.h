@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2020 Ryan Blais, Hugo Burd, Byron Kontou, and Jeff Stacey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef PACK14_HEADER
+#define PACK14_HEADER
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Packed 14-bit frames (.b14 files)
+ *
+ * The Lepton only gives 14 bits per pixel, so instead of a uint16 each, every
+ * 4 pixels are stored in 7 bytes:
+ *
+ *     bits 0-13 pixel 0, 14-27 pixel 1, 28-41 pixel 2, 42-55 pixel 3
+ *
+ * of a little-endian 56-bit group. Groups follow each other with no padding,
+ * in the same top-row-first order as the uint16 frames. A frame whose pixel
+ * count isn't a multiple of 4 ends in a partial group with the unused pixels
+ * set to 0.
+ *
+ * Both directions work on a whole 64-bit group at a time, two with SSE2 on
+ * the host, so unpacking runs at about the speed of copying the uint16 frame.
+ * The Cortex-R5 has no NEON and takes the scalar path.
+ */
+
+/* Bytes taken by `count` packed pixels */
+#define PACK14_BYTES(count) ((((count) + 3) / 4) * 7)
+
+/* Packs `count` pixels. Only the low 14 bits of each are kept. */
+void pack14(const uint16_t* pixels, uint8_t* packed, size_t count);
+
+/* Unpacks `count` pixels into uint16s */
+void unpack14(const uint8_t* packed, uint16_t* pixels, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -22,6 +22,8 @@ SOFTWARE.
 
 #include "perf.h"
 
+#if defined(__arm__)
+
 void init_ccount() {
     uint32_t cfg = 1; // enable all counters
 
@@ -45,3 +47,29 @@ uint32_t get_ccount() {
     asm volatile ("MRC p15, 0, %0, c9, c13, 0\t\n" : "=r"(value));
     return value;
 }
+
+#else
+
+// Host builds (the test image generator's GUI) count in the same units, 64
+// cycles of the time stamp counter, or 64 ns where there isn't one.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+void init_ccount() {
+}
+
+uint32_t get_ccount() {
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)(__rdtsc() >> 6);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(((uint64_t)now.tv_sec * 1000000000u + now.tv_nsec) >> 6);
+#endif
+}
+
+#endif
@@ -25,6 +25,7 @@ SOFTWARE.
 
 #include <stdint.h>
 
+// Cycle counter, counting once every 64 cycles
 void init_ccount();
 
 uint32_t get_ccount();
@@ -18,6 +18,42 @@ proc imread { var_name file_name } {
     mrd -bin -size h -file $file_name $base_addr [expr 160*120]
 }
 
+# reads one sample out of an open .hrzpack dataset (see dataset.h in the
+# test image generator). The frame is written to frame_file so it can be
+# copied into memory, and the SimulationState bytes are returned along with
+# the sample's fuzz run index.
+proc pack_sample { packf header slot frame_file } {
+    dict with header {
+        seek $packf [expr $index_offset + $slot * 24]
+        binary scan [read $packf 24] www sample_index frame_offset state_offset
+
+        seek $packf $frame_offset
+        set frame [read $packf [expr $frame_width * $frame_height * 2]]
+
+        seek $packf $state_offset
+        set state [read $packf $state_size]
+    }
+
+    set out [open $frame_file "wb"]
+    puts -nonewline $out $frame
+    close $out
+
+    return [list $sample_index $state]
+}
+
+# reads the header of an open .hrzpack dataset into a dict
+proc pack_header { packf } {
+    seek $packf 0
+    binary scan [read $packf 88] a8iiiiiiwwwwww magic version flags frame_width frame_height bytes_per_pixel state_size count index_offset frames_offset frame_stride states_offset state_stride
+    if { $magic ne "HRZPACK\0" || $version != 1 || ($flags & 1) == 0 } {
+        error "not a complete version 1 .hrzpack dataset"
+    }
+    if { $frame_width != 160 || $frame_height != 120 } {
+        error "dataset frames are ${frame_width}x${frame_height}, expected 160x120"
+    }
+    return [dict create frame_width $frame_width frame_height $frame_height state_size $state_size count $count index_offset $index_offset]
+}
+
 proc isnan { x } {
     if { ![string is double $x] || $x != $x} {
         return 1
@@ -77,12 +113,13 @@ proc quat_rotate_vector { rw rx ry rz vx vy vz } {
 set parameters {
     { build         "Build the BSP and application before testing"}
     { hw            "Run the test on a connected Zynq MPSoC" }
-    { tdir.arg ""   "Test on every available image in the specified directory" }
+    { tdir.arg ""   "Test on every available image (.b14, .irc or .bin) in the specified directory" }
+    { pack.arg ""   "Test on every sample in the specified .hrzpack dataset" }
     { alg.arg 0     "Select which algorithm to use: 0 - edge detection and least-squares, 1 - edge detection and chord fit, 2 - vsearch" }
     { csv.arg ""    "Write results to CSV file of specified name"}
 }
 
-set usage "usage: xsct run_test.tcl \[-build\] \[-hw\] \[-alg \{0 | 1 | 2\}\] \{-tdir test_dir | bin_file\}"
+set usage "usage: xsct run_test.tcl \[-build\] \[-hw\] \[-alg \{0 | 1 | 2\}\] \{-tdir test_dir | -pack dataset.hrzpack | image_file\}"
 
 # this parses the specified parameters into an array and leaves any other arguments
 array set args [cmdline::getoptions argv $parameters $usage]
@@ -94,10 +131,21 @@ if { $args(csv) eq ""} {
 }
 
 # detemine what test data we want to use 
-if { $args(tdir) eq "" } {
+if { $args(pack) ne "" } {
+    # with a dataset, the tests are its slots
+    set use_pack 1
+    set packf [open $args(pack) "rb"]
+    set pack_header [pack_header $packf]
+    set testfiles {}
+    for {set i 0} {$i < [dict get $pack_header count]} {incr i} {
+        lappend testfiles $i
+    }
+} elseif { $args(tdir) eq "" } {
+    set use_pack 0
     set testfiles $argv
 } else {
-    set testfiles [lsort -dictionary [glob $args(tdir)/*.bin]]
+    set use_pack 0
+    set testfiles [lsort -dictionary [glob $args(tdir)/*.{b14,irc,bin}]]
 }
 
 ##########################
@@ -195,21 +243,50 @@ con -block -timeout 10
 bpdisable 0
 
 foreach testfile $testfiles {
-    puts "Starting test for $testfile"
+    if { $use_pack } {
+        # pull the frame and parameters for this slot out of the dataset
+        set image_file $testing_dir/pack_frame.bin
+        lassign [pack_sample $packf $pack_header $testfile $image_file] sample_index hrz
+        set testfile "$args(pack):$sample_index"
+    } else {
+        set image_file $testing_dir/$testfile
 
-    # open the image parameter file and load the data
-    set hrz_filename [concat [lindex [split $testfile .] 0].hrz]
-    set hrz_file [open $hrz_filename "rb"]
-    set hrz [read $hrz_file]
-    close $hrz_file
+        # open the image parameter file and load the data
+        set hrz_filename [concat [lindex [split $testfile .] 0].hrz]
+        set hrz_file [open $hrz_filename "rb"]
+        set hrz [read $hrz_file]
+        close $hrz_file
+    }
+
+    puts "Starting test for $testfile"
 
     # extract values from the file
     binary scan $hrz ffffffffffffffffffffsssf16 qwref qxref qyref qzref mquatw mquatx mquaty mquatz altitude latitude longitude noise_seed noise_stdev visible_atmosphere_height nxref nyref nzref magx magy magz magreadingx magreadingy magreadingz mag_trans
 
-    # insert the image into memory
-    set image_base_addr [lindex [print &$image_variable_name] 2]
-    puts "\tCopying image data from $testfile into memory"
-    mwr -bin -size h -file $testing_dir/$testfile $image_base_addr [expr 160*120]
+    # insert the image into memory. Packed .b14 frames (see pack14.h) go
+    # into PackedImg, 4 pixels in 7 bytes, and main unpacks them. Compressed
+    # .irc frames (see ircodec.h) go into CompressedImg and main decodes them.
+    if { [file extension $image_file] eq ".b14" } {
+        set image_base_addr [lindex [print &PackedImg] 2]
+        puts "\tCopying packed image data from $testfile into memory"
+        mwr -bin -size b -file $image_file $image_base_addr [expr 160*120/4*7]
+        print -set packed_input 1
+        print -set compressed_input 0
+    } elseif { [file extension $image_file] eq ".irc" } {
+        set image_base_addr [lindex [print &CompressedImg] 2]
+        set image_size [file size $image_file]
+        puts "\tCopying $image_size bytes of compressed image data from $testfile into memory"
+        mwr -bin -size b -file $image_file $image_base_addr $image_size
+        print -set compressed_size $image_size
+        print -set packed_input 0
+        print -set compressed_input 1
+    } else {
+        set image_base_addr [lindex [print &$image_variable_name] 2]
+        puts "\tCopying image data from $testfile into memory"
+        mwr -bin -size h -file $image_file $image_base_addr [expr 160*120]
+        print -set packed_input 0
+        print -set compressed_input 0
+    }
 
     #imread TestImg out.bin
     
@@ -322,6 +399,8 @@ foreach testfile $testfiles {
     if { $reject } {
         if { $reject == 1 } {
             puts "\t***Horizon determination failed - not enough points***"
+        } elseif { $reject == 3 } {
+            puts "\t***Horizon determination failed - couldn't decode the image***"
         } else {
             puts "\t***Horizon determination failed - radius too small***"
         }
@@ -385,3 +464,7 @@ foreach testfile $testfiles {
 if {$use_csv} {
     close $csvf
 }
+
+if {$use_pack} {
+    close $packf
+}